@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Common.h"
+#include "Memory.h"
+
+#include <new>
+
+namespace Probulator
+{
+	// Allocations are tracked in the memory account of the calling thread (see Memory.h)
+	inline void* alignedMalloc(size_t size, size_t alignment)
+	{
+		return memoryAllocate(size, alignment);
+	}
+
+	inline void alignedFree(void* ptr)
+	{
+		memoryFree(ptr);
+	}
+
+	// Standard library compatible allocator that returns memory aligned to the given power of two
+	template <typename T, size_t Alignment>
+	struct AlignedAllocator
+	{
+		typedef T value_type;
+
+		template <typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+		AlignedAllocator() {}
+		template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+		T* allocate(size_t count)
+		{
+			if (count == 0)
+				return nullptr;
+
+			void* ptr = alignedMalloc(count * sizeof(T), Alignment);
+			if (!ptr)
+				throw std::bad_alloc();
+
+			return static_cast<T*>(ptr);
+		}
+
+		void deallocate(T* ptr, size_t)
+		{
+			alignedFree(ptr);
+		}
+	};
+
+	template <typename T, typename U, size_t Alignment>
+	inline bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return true; }
+
+	template <typename T, typename U, size_t Alignment>
+	inline bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return false; }
+}
@@ -0,0 +1,29 @@
+#include "CosineConvolution.h"
+#include "CosineConvolutionKernel.h"
+#include "Simd.h"
+#include "Trace.h"
+
+namespace Probulator
+{
+	void cosineConvolveBatch(const RadianceSampleArray& samples,
+		const float* normalX, const float* normalY, const float* normalZ, u32 normalCount,
+		float* outR, float* outG, float* outB)
+	{
+		PROBULATOR_TRACE_SCOPE("cosineConvolveBatch");
+
+#if PROBULATOR_SIMD_X86
+		switch (simdGetIsa())
+		{
+		case SimdIsa_AVX512:
+			cosineConvolveBatchAVX512(samples, normalX, normalY, normalZ, normalCount, outR, outG, outB);
+			return;
+		case SimdIsa_AVX2:
+			cosineConvolveBatchAVX2(samples, normalX, normalY, normalZ, normalCount, outR, outG, outB);
+			return;
+		default:
+			break;
+		}
+#endif
+		cosineConvolveBatchKernel<ScalarLane, 4>(samples, normalX, normalY, normalZ, normalCount, outR, outG, outB);
+	}
+}
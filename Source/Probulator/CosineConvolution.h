@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Common.h"
+#include "RadianceSample.h"
+
+namespace Probulator
+{
+	// Computes out[i] = sum(samples.value[j] * max(0, dot(normal[i], samples.direction[j]))) for all sample / normal pairs.
+	// Sample values are typically radiance multiplied by texel solid angle, which turns the sum into
+	// an exact clamped cosine convolution of the environment. Uses the widest instruction set reported by simdGetIsa.
+	void cosineConvolveBatch(const RadianceSampleArray& samples,
+		const float* normalX, const float* normalY, const float* normalZ, u32 normalCount,
+		float* outR, float* outG, float* outB);
+}
@@ -0,0 +1,13 @@
+// Compiled with AVX2 and FMA code generation enabled (see CMakeLists.txt)
+
+#include "CosineConvolutionKernel.h"
+
+namespace Probulator
+{
+	void cosineConvolveBatchAVX2(const RadianceSampleArray& samples,
+		const float* normalX, const float* normalY, const float* normalZ, u32 normalCount,
+		float* outR, float* outG, float* outB)
+	{
+		cosineConvolveBatchKernel<Avx2Lane, 2>(samples, normalX, normalY, normalZ, normalCount, outR, outG, outB);
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+// Clamped cosine convolution kernel shared by per-instruction-set translation units.
+// Use cosineConvolveBatch from CosineConvolution.h instead of including this directly.
+
+#include "CosineConvolution.h"
+#include "SimdLane.h"
+
+#include <algorithm>
+
+namespace Probulator
+{
+	// Implemented in translation units compiled for the corresponding instruction set
+	void cosineConvolveBatchAVX2(const RadianceSampleArray& samples,
+		const float* normalX, const float* normalY, const float* normalZ, u32 normalCount,
+		float* outR, float* outG, float* outB);
+	void cosineConvolveBatchAVX512(const RadianceSampleArray& samples,
+		const float* normalX, const float* normalY, const float* normalZ, u32 normalCount,
+		float* outR, float* outG, float* outB);
+
+namespace
+{
+	// Samples are processed in blocks that stay in L1 cache while all normals are visited
+	const u32 CosineConvolutionSampleBlockSize = 1024;
+
+	// Accumulates a block of samples into GroupSize * Lane::Width consecutive normals.
+	// Normals and accumulators of the group are kept in registers for the whole sample block.
+	template <typename Lane, u32 GroupSize>
+	inline void cosineConvolveGroup(const RadianceSampleArray& samples, u32 sampleBegin, u32 sampleEnd,
+		const float* normalX, const float* normalY, const float* normalZ,
+		float* outR, float* outG, float* outB)
+	{
+		Lane nx[GroupSize], ny[GroupSize], nz[GroupSize];
+		Lane r[GroupSize], g[GroupSize], b[GroupSize];
+
+		for (u32 i = 0; i < GroupSize; ++i)
+		{
+			const u32 offset = i * Lane::Width;
+			nx[i] = Lane::load(normalX + offset);
+			ny[i] = Lane::load(normalY + offset);
+			nz[i] = Lane::load(normalZ + offset);
+			r[i] = Lane::load(outR + offset);
+			g[i] = Lane::load(outG + offset);
+			b[i] = Lane::load(outB + offset);
+		}
+
+		const Lane zero(0.0f);
+
+		for (u32 sampleIt = sampleBegin; sampleIt != sampleEnd; ++sampleIt)
+		{
+			const Lane dx(samples.directionX[sampleIt]);
+			const Lane dy(samples.directionY[sampleIt]);
+			const Lane dz(samples.directionZ[sampleIt]);
+			const Lane vr(samples.valueR[sampleIt]);
+			const Lane vg(samples.valueG[sampleIt]);
+			const Lane vb(samples.valueB[sampleIt]);
+
+			for (u32 i = 0; i < GroupSize; ++i)
+			{
+				const Lane cosTerm = max(nx[i] * dx + ny[i] * dy + nz[i] * dz, zero);
+				r[i] = r[i] + vr * cosTerm;
+				g[i] = g[i] + vg * cosTerm;
+				b[i] = b[i] + vb * cosTerm;
+			}
+		}
+
+		for (u32 i = 0; i < GroupSize; ++i)
+		{
+			const u32 offset = i * Lane::Width;
+			r[i].store(outR + offset);
+			g[i].store(outG + offset);
+			b[i].store(outB + offset);
+		}
+	}
+
+	template <typename Lane, u32 GroupSize>
+	inline void cosineConvolveBatchKernel(const RadianceSampleArray& samples,
+		const float* normalX, const float* normalY, const float* normalZ, u32 normalCount,
+		float* outR, float* outG, float* outB)
+	{
+		const u32 groupWidth = GroupSize * Lane::Width;
+		const u32 fullGroupEnd = normalCount - normalCount % groupWidth;
+
+		std::fill(outR, outR + normalCount, 0.0f);
+		std::fill(outG, outG + normalCount, 0.0f);
+		std::fill(outB, outB + normalCount, 0.0f);
+
+		// Remaining normals are copied into a zero-padded group.
+		// Zero normals produce zero cosine terms, so padding never contributes.
+		float tailNormalX[groupWidth] = {}, tailNormalY[groupWidth] = {}, tailNormalZ[groupWidth] = {};
+		float tailR[groupWidth] = {}, tailG[groupWidth] = {}, tailB[groupWidth] = {};
+		const u32 tailCount = normalCount - fullGroupEnd;
+		std::copy(normalX + fullGroupEnd, normalX + normalCount, tailNormalX);
+		std::copy(normalY + fullGroupEnd, normalY + normalCount, tailNormalY);
+		std::copy(normalZ + fullGroupEnd, normalZ + normalCount, tailNormalZ);
+
+		const u32 sampleCount = samples.size();
+		for (u32 sampleBegin = 0; sampleBegin < sampleCount; sampleBegin += CosineConvolutionSampleBlockSize)
+		{
+			const u32 sampleEnd = std::min(sampleBegin + CosineConvolutionSampleBlockSize, sampleCount);
+
+			for (u32 normalIt = 0; normalIt != fullGroupEnd; normalIt += groupWidth)
+			{
+				cosineConvolveGroup<Lane, GroupSize>(samples, sampleBegin, sampleEnd,
+					normalX + normalIt, normalY + normalIt, normalZ + normalIt,
+					outR + normalIt, outG + normalIt, outB + normalIt);
+			}
+
+			if (tailCount)
+			{
+				cosineConvolveGroup<Lane, GroupSize>(samples, sampleBegin, sampleEnd,
+					tailNormalX, tailNormalY, tailNormalZ, tailR, tailG, tailB);
+			}
+		}
+
+		std::copy(tailR, tailR + tailCount, outR + fullGroupEnd);
+		std::copy(tailG, tailG + tailCount, outG + fullGroupEnd);
+		std::copy(tailB, tailB + tailCount, outB + fullGroupEnd);
+	}
+}
+}
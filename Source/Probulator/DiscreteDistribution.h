@@ -1,74 +1,114 @@
 #pragma once
 
-#include <random>
+#include "Math.h"
+#include "Thread.h"
+
+#include <algorithm>
 #include <vector>
 
 namespace Probulator
 {
 	// Discrete probability distribution sampling based on alias method
 	// http://www.keithschwarz.com/darts-dice-coins
+	// Works with any generator of 32 bit random numbers, such as Pcg32 or std::mt19937.
 	template <typename T>
 	struct DiscreteDistribution
 	{
-		typedef std::pair<T, size_t> Cell;
+		// Probability of keeping the cell index and the index to use otherwise (8 bytes for float weights)
+		struct Cell
+		{
+			T probability;
+			u32 alias;
+		};
 
 		DiscreteDistribution(const T* weights, size_t count, T weightSum)
 		{
-			std::vector<Cell> large;
-			std::vector<Cell> small;
-			for (size_t i = 0; i < count; ++i)
+			m_cells.resize(count);
+
+			// Scaled probabilities are computed and classified in parallel chunks.
+			// Chunks are concatenated in order, so the table does not depend on thread count.
+
+			const u32 chunkSize = 1 << 16;
+			const u32 chunkCount = u32((count + chunkSize - 1) / chunkSize);
+
+			std::vector<std::vector<u32>> smallChunks(chunkCount);
+			std::vector<std::vector<u32>> largeChunks(chunkCount);
+
+			parallelForRange(0u, chunkCount, 1, [&](const ParallelRange& range)
+			{
+				for (u32 chunkIt = range.begin; chunkIt != range.end; ++chunkIt)
+				{
+					const u32 chunkBegin = chunkIt * chunkSize;
+					const u32 chunkEnd = u32(std::min<size_t>(chunkBegin + chunkSize, count));
+					for (u32 i = chunkBegin; i != chunkEnd; ++i)
+					{
+						T p = weights[i] * count / weightSum;
+						m_cells[i] = { p, i };
+						if (p < T(1)) smallChunks[chunkIt].push_back(i);
+						else largeChunks[chunkIt].push_back(i);
+					}
+				}
+			});
+
+			std::vector<u32> small;
+			std::vector<u32> large;
+			for (u32 chunkIt = 0; chunkIt < chunkCount; ++chunkIt)
 			{
-				T p = weights[i] * count / weightSum;
-				if (p < T(1)) small.push_back({ p, i });
-				else large.push_back({ p, i });
+				small.insert(small.end(), smallChunks[chunkIt].begin(), smallChunks[chunkIt].end());
+				large.insert(large.end(), largeChunks[chunkIt].begin(), largeChunks[chunkIt].end());
 			}
 
-			m_cells.resize(count, { T(0), 0 });
+			// Pairing is sequential, but only touches indices and cell probabilities
 
 			while (large.size() && small.size())
 			{
-				auto l = small.back(); small.pop_back();
-				auto g = large.back(); large.pop_back();
-				m_cells[l.second].first = l.first;
-				m_cells[l.second].second = g.second;
-				g.first = (l.first + g.first) - T(1);
-				if (g.first < T(1))
+				u32 l = small.back(); small.pop_back();
+				u32 g = large.back();
+				m_cells[l].alias = g;
+
+				T& gp = m_cells[g].probability;
+				gp = (m_cells[l].probability + gp) - T(1);
+				if (gp < T(1))
 				{
+					large.pop_back();
 					small.push_back(g);
 				}
-				else
-				{
-					large.push_back(g);
-				}
 			}
 
-			while (large.size())
+			for (u32 g : large)
 			{
-				auto g = large.back(); large.pop_back();
-				m_cells[g.second].first = T(1);
+				m_cells[g].probability = T(1);
 			}
 
-			while (small.size())
+			for (u32 l : small)
 			{
-				auto l = small.back(); small.pop_back();
-				m_cells[l.second].first = T(1);
+				m_cells[l].probability = T(1);
 			}
 		}
 
-		size_t operator()(std::mt19937& rng) const
+		template <typename Rng>
+		u32 operator()(Rng& rng) const
 		{
-			size_t i = rng() % m_cells.size();
-			std::uniform_real_distribution<T> uniformDistribution;
-			if (uniformDistribution(rng) <= m_cells[i].first)
-			{
-				return i;
-			}
-			else
+			// Multiply-shift maps a 32 bit random number to a cell without division
+			u32 i = u32((u64(u32(rng())) * m_cells.size()) >> 32);
+			const Cell& cell = m_cells[i];
+			return T(randomUnitFloat(rng)) < cell.probability ? i : cell.alias;
+		}
+
+		// Produces the same indices as calling operator() count times
+		template <typename Rng>
+		void sampleBatch(u32 count, u32* out, Rng& rng) const
+		{
+			const u64 cellCount = m_cells.size();
+			const Cell* cells = m_cells.data();
+			for (u32 sampleIt = 0; sampleIt < count; ++sampleIt)
 			{
-				return m_cells[i].second;
+				u32 i = u32((u64(u32(rng())) * cellCount) >> 32);
+				const Cell& cell = cells[i];
+				out[sampleIt] = T(randomUnitFloat(rng)) < cell.probability ? i : cell.alias;
 			}
 		}
 
 		std::vector<Cell> m_cells;
 	};
-}
\ No newline at end of file
+}
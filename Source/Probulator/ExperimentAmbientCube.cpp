@@ -1,79 +1,59 @@
 #include "ExperimentAmbientCube.h"
+#include "Memory.h"
+#include "Trace.h"
 
 #include <Eigen/Eigen>
-#include <Eigen/nnls.h>
 
 namespace Probulator {
 
-ExperimentAmbientCube::AmbientCube ExperimentAmbientCube::solveAmbientCubeLeastSquares(const ImageBase<vec3>& directions, const Image& irradiance)
+ExperimentAmbientCube::AmbientCube ExperimentAmbientCube::solveAmbientCubeLeastSquares(const ImageBase<vec3>& directions, const Image& irradiance, NnlsActiveSet* activeSet)
 {
+	PROBULATOR_TRACE_SCOPE("solveAmbientCubeLeastSquares");
+	PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
 	using namespace Eigen;
 
 	AmbientCube ambientCube;
 
 	const u64 sampleCount = directions.getPixelCount();
 
-	MatrixXf A;
-	A.resize(sampleCount, 6);
+	// Every direction has at most one non-zero basis weight per axis (dirSquared on the side it points to),
+	// so normal equations are accumulated directly without building the design matrix.
+
+	MatrixXd ata = MatrixXd::Zero(6, 6);
+	MatrixXd atb = MatrixXd::Zero(6, 3);
 
 	for (u64 sampleIt = 0; sampleIt < sampleCount; ++sampleIt)
 	{
 		const vec3& direction = directions.at(sampleIt);
+		const vec3 value = (vec3)irradiance.at(sampleIt);
 		vec3 dirSquared = direction * direction;
 
-		if (direction.x < 0)
-		{
-			A(sampleIt, 0) = dirSquared.x;
-			A(sampleIt, 1) = 0.0f;
-		}
-		else
+		u32 basisIndex[3] =
 		{
-			A(sampleIt, 0) = 0.0f;
-			A(sampleIt, 1) = dirSquared.x;
-		}
-
-		if (direction.y < 0)
-		{
-			A(sampleIt, 2) = dirSquared.y;
-			A(sampleIt, 3) = 0.0f;
-		}
-		else
-		{
-			A(sampleIt, 2) = 0.0f;
-			A(sampleIt, 3) = dirSquared.y;
-		}
+			direction.x < 0 ? 0u : 1u,
+			direction.y < 0 ? 2u : 3u,
+			direction.z < 0 ? 4u : 5u,
+		};
 
-		if (direction.z < 0)
+		for (u32 i = 0; i < 3; ++i)
 		{
-			A(sampleIt, 4) = dirSquared.z;
-			A(sampleIt, 5) = 0.0f;
-		}
-		else
-		{
-			A(sampleIt, 4) = 0.0f;
-			A(sampleIt, 5) = dirSquared.z;
+			for (u32 j = 0; j < 3; ++j)
+			{
+				ata(basisIndex[i], basisIndex[j]) += double(dirSquared[i]) * dirSquared[j];
+			}
+			for (u32 channelIt = 0; channelIt < 3; ++channelIt)
+			{
+				atb(basisIndex[i], channelIt) += double(dirSquared[i]) * value[channelIt];
+			}
 		}
 	}
 
-	NNLS<MatrixXf> solver(A);
-
-	VectorXf b;
-	b.resize(sampleCount);
+	NnlsActiveSet localActiveSet;
+	MatrixXd x = nnlsSolveNormalEquations(ata, atb, activeSet ? *activeSet : localActiveSet);
 
-	for (u32 channelIt = 0; channelIt < 3; ++channelIt)
+	for (u64 basisIt = 0; basisIt < 6; ++basisIt)
 	{
-		for (u64 sampleIt = 0; sampleIt < sampleCount; ++sampleIt)
-		{
-			b[sampleIt] = irradiance.at(sampleIt)[channelIt];
-		}
-
-		solver.solve(b);
-		VectorXf x = solver.x();
-
-		for (u64 basisIt = 0; basisIt < 6; ++basisIt)
-		{
-			ambientCube.irradiance[basisIt][channelIt] = x[basisIt];
-		}
+		ambientCube.irradiance[basisIt] = vec3(x(basisIt, 0), x(basisIt, 1), x(basisIt, 2));
 	}
 
 	return ambientCube;
@@ -81,6 +61,8 @@ ExperimentAmbientCube::AmbientCube ExperimentAmbientCube::solveAmbientCubeLeastS
 
 ExperimentAmbientCube::AmbientCube ExperimentAmbientCube::solveAmbientCubeProjection(const Image& irradiance)
 {
+	PROBULATOR_TRACE_SCOPE("solveAmbientCubeProjection");
+	PROBULATOR_MEMORY_SCOPE(MemoryPhase_Projection);
 	AmbientCube ambientCube;
 
 	vec3 cubeDirections[6] =
@@ -112,7 +94,7 @@ void ExperimentAmbientCube::run(SharedData& data)
 	}
 	else
 	{
-		ambientCube = solveAmbientCubeLeastSquares(data.m_directionImage, m_input->m_irradianceImage);
+		ambientCube = solveAmbientCubeLeastSquares(data.m_directionImage, m_input->m_irradianceImage, &m_activeSet);
 	}
 
 	m_radianceImage = Image(data.m_outputSize);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Probulator/Experiments.h>
+#include <Probulator/NonNegativeLeastSquares.h>
 
 namespace Probulator {
 
@@ -25,7 +26,9 @@ public:
 		}
 	};
 
-	static AmbientCube solveAmbientCubeLeastSquares(const ImageBase<vec3>& directions, const Image& irradiance);
+	// Non-negative least squares fit, optionally warm started from and updating activeSet
+	static AmbientCube solveAmbientCubeLeastSquares(const ImageBase<vec3>& directions, const Image& irradiance,
+		NnlsActiveSet* activeSet = nullptr);
 	static AmbientCube solveAmbientCubeProjection(const Image& irradiance);
 
 	void run(SharedData& data) override;
@@ -43,6 +46,9 @@ public:
     }
 
 	bool m_projectionEnabled = false;
+
+	// Kept between runs to warm start the solve for the next probe
+	NnlsActiveSet m_activeSet;
 };
 
 }
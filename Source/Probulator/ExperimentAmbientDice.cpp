@@ -2,6 +2,8 @@
 #include <fstream>
 
 #include "ExperimentAmbientDice.h"
+#include "Memory.h"
+#include "Trace.h"
 
 #include <Eigen/Eigen>
 #include <Eigen/nnls.h>
@@ -342,6 +344,7 @@ namespace Probulator {
     
     Eigen::MatrixXf AmbientDice::computeGramMatrixBezier()
     {
+        PROBULATOR_TRACE_SCOPE("AmbientDice::computeGramMatrixBezier");
         using namespace Eigen;
         
         const u32 sampleCount = 32768;
@@ -392,6 +395,7 @@ namespace Probulator {
     
     Eigen::MatrixXf AmbientDice::computeGramMatrixLinear()
     {
+        PROBULATOR_TRACE_SCOPE("AmbientDice::computeGramMatrixLinear");
         using namespace Eigen;
         
         const u32 sampleCount = 32768;
@@ -431,6 +435,7 @@ namespace Probulator {
     
     Eigen::MatrixXf AmbientDice::computeGramMatrixSRBF()
     {
+        PROBULATOR_TRACE_SCOPE("AmbientDice::computeGramMatrixSRBF");
         using namespace Eigen;
         
         const u32 sampleCount = 32768;
@@ -464,149 +469,144 @@ namespace Probulator {
         return gram;
     }
     
-    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresLinear(ImageBase<vec3>& directions, const Image& irradiance)
+    // Gram matrices only depend on the basis, so each one is built and factorized once and shared by all solves.
+    // Function-local statics are initialized safely when experiments run concurrently.
+
+    static const Eigen::JacobiSVD<Eigen::MatrixXf>& getGramSolverLinear()
+    {
+        static const Eigen::JacobiSVD<Eigen::MatrixXf> solver(AmbientDice::computeGramMatrixLinear(), Eigen::ComputeThinU | Eigen::ComputeThinV);
+        return solver;
+    }
+
+    static const Eigen::JacobiSVD<Eigen::MatrixXf>& getGramSolverBezier()
+    {
+        static const Eigen::JacobiSVD<Eigen::MatrixXf> solver(AmbientDice::computeGramMatrixBezier(), Eigen::ComputeThinU | Eigen::ComputeThinV);
+        return solver;
+    }
+
+    static const Eigen::JacobiSVD<Eigen::MatrixXf>& getGramSolverSRBF()
     {
+        static const Eigen::JacobiSVD<Eigen::MatrixXf> solver(AmbientDice::computeGramMatrixSRBF(), Eigen::ComputeThinU | Eigen::ComputeThinV);
+        return solver;
+    }
+
+    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresLinear(const SharedData& data, const Image& irradiance)
+    {
+        PROBULATOR_TRACE_SCOPE("solveAmbientDiceLeastSquaresLinear");
+        PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
         using namespace Eigen;
         
         AmbientDice ambientDice;
         
-        VectorXf momentsR = VectorXf::Zero(12);
-        VectorXf momentsG = VectorXf::Zero(12);
-        VectorXf momentsB = VectorXf::Zero(12);
-        
-        ivec2 imageSize = directions.getSize();
-        directions.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+        MatrixXf moments = data.parallelReduceTexels(MatrixXf(MatrixXf::Zero(12, 3)),
+                               [&](MatrixXf& accumulator, const vec3& direction, float texelArea, u32 texelIndex)
                                {
-                                   float texelArea = latLongTexelArea(pixelPos, imageSize);
-                                   
-                                   const vec4& color = irradiance.at(pixelPos);
+                                   const vec4& color = irradiance.at(texelIndex);
                                    
                                    u32 i0, i1, i2;
                                    u32 triIndex;
                                    float b0, b1, b2;
                                    AmbientDice::computeBarycentrics(direction, &triIndex, &i0, &i1, &i2, &b0, &b1, &b2);
                                    
-                                   momentsR[i0] += b0 * color.r * texelArea;
-                                   momentsR[i1] += b1 * color.r * texelArea;
-                                   momentsR[i2] += b2 * color.r * texelArea;
+                                   accumulator(i0, 0) += b0 * color.r * texelArea;
+                                   accumulator(i1, 0) += b1 * color.r * texelArea;
+                                   accumulator(i2, 0) += b2 * color.r * texelArea;
                                    
-                                   momentsG[i0] += b0 * color.g * texelArea;
-                                   momentsG[i1] += b1 * color.g * texelArea;
-                                   momentsG[i2] += b2 * color.g * texelArea;
+                                   accumulator(i0, 1) += b0 * color.g * texelArea;
+                                   accumulator(i1, 1) += b1 * color.g * texelArea;
+                                   accumulator(i2, 1) += b2 * color.g * texelArea;
                                    
-                                   momentsB[i0] += b0 * color.b * texelArea;
-                                   momentsB[i1] += b1 * color.b * texelArea;
-                                   momentsB[i2] += b2 * color.b * texelArea;
-                               });
-        
-        MatrixXf gramLinear = AmbientDice::computeGramMatrixLinear();
+                                   accumulator(i0, 2) += b0 * color.b * texelArea;
+                                   accumulator(i1, 2) += b1 * color.b * texelArea;
+                                   accumulator(i2, 2) += b2 * color.b * texelArea;
+                               }, [](const MatrixXf& a, const MatrixXf& b) -> MatrixXf { return a + b; });
         
-        const auto solver = gramLinear.jacobiSvd(ComputeThinU | ComputeThinV);
-        VectorXf R = solver.solve(momentsR);
-        VectorXf G = solver.solve(momentsG);
-        VectorXf B = solver.solve(momentsB);
+        MatrixXf x = getGramSolverLinear().solve(moments);
         
         for (u64 basisIt = 0; basisIt < 12; ++basisIt)
         {
-            ambientDice.vertices[basisIt].value[0] = R[basisIt];
-            ambientDice.vertices[basisIt].value[1] = G[basisIt];
-            ambientDice.vertices[basisIt].value[2] = B[basisIt];
+            ambientDice.vertices[basisIt].value[0] = x(basisIt, 0);
+            ambientDice.vertices[basisIt].value[1] = x(basisIt, 1);
+            ambientDice.vertices[basisIt].value[2] = x(basisIt, 2);
         }
         
         return ambientDice;
     }
     
-    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresBezier(ImageBase<vec3>& directions, const Image& irradiance)
+    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresBezier(const SharedData& data, const Image& irradiance)
     {
+        PROBULATOR_TRACE_SCOPE("solveAmbientDiceLeastSquaresBezier");
+        PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
         using namespace Eigen;
         
         AmbientDice ambientDice;
         
-        MatrixXf moments = MatrixXf::Zero(36, 3);
-        
-        ivec2 imageSize = directions.getSize();
-        directions.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+        MatrixXf moments = data.parallelReduceTexels(MatrixXf(MatrixXf::Zero(36, 3)),
+                               [&](MatrixXf& accumulator, const vec3& direction, float texelArea, u32 texelIndex)
                                {
-                                   float texelArea = latLongTexelArea(pixelPos, imageSize);
-                                   
-                                   const vec4& color = irradiance.at(pixelPos);
+                                   const vec4& color = irradiance.at(texelIndex);
                                    
                                    u32 i0, i1, i2;
                                    AmbientDice::VertexWeights<float> weights[3];
                                    AmbientDice::hybridCubicBezierWeights(direction, &i0, &i1, &i2, &weights[0], &weights[1], &weights[2]);
                                    
-                                   moments(3 * i0 + 0, 0) += weights[0].value * color.r * texelArea;
-                                   moments(3 * i0 + 1, 0) += weights[0].directionalDerivativeU * color.r * texelArea;
-                                   moments(3 * i0 + 2, 0) += weights[0].directionalDerivativeV * color.r * texelArea;
-                                   moments(3 * i1 + 0, 0) += weights[1].value * color.r * texelArea;
-                                   moments(3 * i1 + 1, 0) += weights[1].directionalDerivativeU * color.r * texelArea;
-                                   moments(3 * i1 + 2, 0) += weights[1].directionalDerivativeV * color.r * texelArea;
-                                   moments(3 * i2 + 0, 0) += weights[2].value * color.r * texelArea;
-                                   moments(3 * i2 + 1, 0) += weights[2].directionalDerivativeU * color.r * texelArea;
-                                   moments(3 * i2 + 2, 0) += weights[2].directionalDerivativeV * color.r * texelArea;
-                                   moments(3 * i0 + 0, 1) += weights[0].value * color.g * texelArea;
-                                   moments(3 * i0 + 1, 1) += weights[0].directionalDerivativeU * color.g * texelArea;
-                                   moments(3 * i0 + 2, 1) += weights[0].directionalDerivativeV * color.g * texelArea;
-                                   moments(3 * i1 + 0, 1) += weights[1].value * color.g * texelArea;
-                                   moments(3 * i1 + 1, 1) += weights[1].directionalDerivativeU * color.g * texelArea;
-                                   moments(3 * i1 + 2, 1) += weights[1].directionalDerivativeV * color.g * texelArea;
-                                   moments(3 * i2 + 0, 1) += weights[2].value * color.g * texelArea;
-                                   moments(3 * i2 + 1, 1) += weights[2].directionalDerivativeU * color.g * texelArea;
-                                   moments(3 * i2 + 2, 1) += weights[2].directionalDerivativeV * color.g * texelArea;
-                                   moments(3 * i0 + 0, 2) += weights[0].value * color.b * texelArea;
-                                   moments(3 * i0 + 1, 2) += weights[0].directionalDerivativeU * color.b * texelArea;
-                                   moments(3 * i0 + 2, 2) += weights[0].directionalDerivativeV * color.b * texelArea;
-                                   moments(3 * i1 + 0, 2) += weights[1].value * color.b * texelArea;
-                                   moments(3 * i1 + 1, 2) += weights[1].directionalDerivativeU * color.b * texelArea;
-                                   moments(3 * i1 + 2, 2) += weights[1].directionalDerivativeV * color.b * texelArea;
-                                   moments(3 * i2 + 0, 2) += weights[2].value * color.b * texelArea;
-                                   moments(3 * i2 + 1, 2) += weights[2].directionalDerivativeU * color.b * texelArea;
-                                   moments(3 * i2 + 2, 2) += weights[2].directionalDerivativeV * color.b * texelArea;
-                               });
-        
-        MatrixXf gram = AmbientDice::computeGramMatrixBezier();
-        
-        auto solver = gram.jacobiSvd(ComputeThinU | ComputeThinV);
-        
-        VectorXf b;
-        b.resize(36);
+                                   accumulator(3 * i0 + 0, 0) += weights[0].value * color.r * texelArea;
+                                   accumulator(3 * i0 + 1, 0) += weights[0].directionalDerivativeU * color.r * texelArea;
+                                   accumulator(3 * i0 + 2, 0) += weights[0].directionalDerivativeV * color.r * texelArea;
+                                   accumulator(3 * i1 + 0, 0) += weights[1].value * color.r * texelArea;
+                                   accumulator(3 * i1 + 1, 0) += weights[1].directionalDerivativeU * color.r * texelArea;
+                                   accumulator(3 * i1 + 2, 0) += weights[1].directionalDerivativeV * color.r * texelArea;
+                                   accumulator(3 * i2 + 0, 0) += weights[2].value * color.r * texelArea;
+                                   accumulator(3 * i2 + 1, 0) += weights[2].directionalDerivativeU * color.r * texelArea;
+                                   accumulator(3 * i2 + 2, 0) += weights[2].directionalDerivativeV * color.r * texelArea;
+                                   accumulator(3 * i0 + 0, 1) += weights[0].value * color.g * texelArea;
+                                   accumulator(3 * i0 + 1, 1) += weights[0].directionalDerivativeU * color.g * texelArea;
+                                   accumulator(3 * i0 + 2, 1) += weights[0].directionalDerivativeV * color.g * texelArea;
+                                   accumulator(3 * i1 + 0, 1) += weights[1].value * color.g * texelArea;
+                                   accumulator(3 * i1 + 1, 1) += weights[1].directionalDerivativeU * color.g * texelArea;
+                                   accumulator(3 * i1 + 2, 1) += weights[1].directionalDerivativeV * color.g * texelArea;
+                                   accumulator(3 * i2 + 0, 1) += weights[2].value * color.g * texelArea;
+                                   accumulator(3 * i2 + 1, 1) += weights[2].directionalDerivativeU * color.g * texelArea;
+                                   accumulator(3 * i2 + 2, 1) += weights[2].directionalDerivativeV * color.g * texelArea;
+                                   accumulator(3 * i0 + 0, 2) += weights[0].value * color.b * texelArea;
+                                   accumulator(3 * i0 + 1, 2) += weights[0].directionalDerivativeU * color.b * texelArea;
+                                   accumulator(3 * i0 + 2, 2) += weights[0].directionalDerivativeV * color.b * texelArea;
+                                   accumulator(3 * i1 + 0, 2) += weights[1].value * color.b * texelArea;
+                                   accumulator(3 * i1 + 1, 2) += weights[1].directionalDerivativeU * color.b * texelArea;
+                                   accumulator(3 * i1 + 2, 2) += weights[1].directionalDerivativeV * color.b * texelArea;
+                                   accumulator(3 * i2 + 0, 2) += weights[2].value * color.b * texelArea;
+                                   accumulator(3 * i2 + 1, 2) += weights[2].directionalDerivativeU * color.b * texelArea;
+                                   accumulator(3 * i2 + 2, 2) += weights[2].directionalDerivativeV * color.b * texelArea;
+                               }, [](const MatrixXf& a, const MatrixXf& b) -> MatrixXf { return a + b; });
+        
+        MatrixXf x = getGramSolverBezier().solve(moments);
         
         for (u32 channelIt = 0; channelIt < 3; ++channelIt)
         {
-            for (u64 lobeIt = 0; lobeIt < 36; ++lobeIt)
-            {
-                b[lobeIt] = moments(lobeIt, channelIt);
-            }
-            
-            VectorXf x = solver.solve(b);
-            
             for (u64 basisIt = 0; basisIt < 12; ++basisIt)
             {
-                ambientDice.vertices[basisIt].value[channelIt] = x[3 * basisIt];
-                ambientDice.vertices[basisIt].directionalDerivativeU[channelIt] = x[3 * basisIt + 1];
-                ambientDice.vertices[basisIt].directionalDerivativeV[channelIt] = x[3 * basisIt + 2];
+                ambientDice.vertices[basisIt].value[channelIt] = x(3 * basisIt, channelIt);
+                ambientDice.vertices[basisIt].directionalDerivativeU[channelIt] = x(3 * basisIt + 1, channelIt);
+                ambientDice.vertices[basisIt].directionalDerivativeV[channelIt] = x(3 * basisIt + 2, channelIt);
             }
         }
         
         return ambientDice;
     }
     
-    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresBezierYCoCg(ImageBase<vec3>& directions, const Image& irradiance)
+    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresBezierYCoCg(const SharedData& data, const Image& irradiance)
     {
+        PROBULATOR_TRACE_SCOPE("solveAmbientDiceLeastSquaresBezierYCoCg");
+        PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
         using namespace Eigen;
         
         AmbientDice ambientDice;
         
-        VectorXf momentsY = VectorXf::Zero(36);
-        VectorXf momentsCo = VectorXf::Zero(12);
-        VectorXf momentsCg = VectorXf::Zero(12);
-        
-        ivec2 imageSize = directions.getSize();
-        directions.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+        // Y moments use all 36 rows of the first column, Co and Cg use the first 12 rows of the other two.
+        MatrixXf moments = data.parallelReduceTexels(MatrixXf(MatrixXf::Zero(36, 3)),
+                               [&](MatrixXf& accumulator, const vec3& direction, float texelArea, u32 texelIndex)
                                {
-                                   float texelArea = latLongTexelArea(pixelPos, imageSize);
-                                   
-                                   const vec4& color = irradiance.at(pixelPos);
+                                   const vec4& color = irradiance.at(texelIndex);
                                    
                                    vec3 colorYCoCg = rgbToYCoCg(vec3(color.r, color.g, color.b));
                                    
@@ -618,33 +618,30 @@ namespace Probulator {
                                    float b0, b1, b2;
                                    AmbientDice::computeBarycentrics(direction, &triIndex, &i0, &i1, &i2, &b0, &b1, &b2);
                                    
-                                   momentsY[3 * i0 + 0] += weights[0].value * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i0 + 1] += weights[0].directionalDerivativeU * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i0 + 2] += weights[0].directionalDerivativeV * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i1 + 0] += weights[1].value * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i1 + 1] += weights[1].directionalDerivativeU * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i1 + 2] += weights[1].directionalDerivativeV * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i2 + 0] += weights[2].value * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i2 + 1] += weights[2].directionalDerivativeU * colorYCoCg.r * texelArea;
-                                   momentsY[3 * i2 + 2] += weights[2].directionalDerivativeV * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i0 + 0, 0) += weights[0].value * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i0 + 1, 0) += weights[0].directionalDerivativeU * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i0 + 2, 0) += weights[0].directionalDerivativeV * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i1 + 0, 0) += weights[1].value * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i1 + 1, 0) += weights[1].directionalDerivativeU * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i1 + 2, 0) += weights[1].directionalDerivativeV * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i2 + 0, 0) += weights[2].value * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i2 + 1, 0) += weights[2].directionalDerivativeU * colorYCoCg.r * texelArea;
+                                   accumulator(3 * i2 + 2, 0) += weights[2].directionalDerivativeV * colorYCoCg.r * texelArea;
                                    
-                                   momentsCo[i0] += b0 * colorYCoCg.g * texelArea;
-                                   momentsCo[i1] += b1 * colorYCoCg.g * texelArea;
-                                   momentsCo[i2] += b2 * colorYCoCg.g * texelArea;
+                                   accumulator(i0, 1) += b0 * colorYCoCg.g * texelArea;
+                                   accumulator(i1, 1) += b1 * colorYCoCg.g * texelArea;
+                                   accumulator(i2, 1) += b2 * colorYCoCg.g * texelArea;
                                    
-                                   momentsCg[i0] += b0 * colorYCoCg.b * texelArea;
-                                   momentsCg[i1] += b1 * colorYCoCg.b * texelArea;
-                                   momentsCg[i2] += b2 * colorYCoCg.b * texelArea;
-                               });
-        
-        MatrixXf gramBezier = AmbientDice::computeGramMatrixBezier();
-        MatrixXf gramLinear = AmbientDice::computeGramMatrixLinear();
+                                   accumulator(i0, 2) += b0 * colorYCoCg.b * texelArea;
+                                   accumulator(i1, 2) += b1 * colorYCoCg.b * texelArea;
+                                   accumulator(i2, 2) += b2 * colorYCoCg.b * texelArea;
+                               }, [](const MatrixXf& a, const MatrixXf& b) -> MatrixXf { return a + b; });
         
-        VectorXf Y = gramBezier.jacobiSvd(ComputeThinU | ComputeThinV).solve(momentsY);
+        VectorXf momentsY = moments.col(0);
+        MatrixXf momentsCoCg = moments.block(0, 1, 12, 2);
         
-        const auto linearSolver = gramLinear.jacobiSvd(ComputeThinU | ComputeThinV);
-        VectorXf Co = linearSolver.solve(momentsCo);
-        VectorXf Cg = linearSolver.solve(momentsCg);
+        VectorXf Y = getGramSolverBezier().solve(momentsY);
+        MatrixXf CoCg = getGramSolverLinear().solve(momentsCoCg);
         
         for (u64 basisIt = 0; basisIt < 12; ++basisIt)
         {
@@ -652,54 +649,45 @@ namespace Probulator {
             ambientDice.vertices[basisIt].directionalDerivativeU[0] = Y[3 * basisIt + 1];
             ambientDice.vertices[basisIt].directionalDerivativeV[0] = Y[3 * basisIt + 2];
             
-            ambientDice.vertices[basisIt].value[1] = Co[basisIt];
-            ambientDice.vertices[basisIt].value[2] = Cg[basisIt];
+            ambientDice.vertices[basisIt].value[1] = CoCg(basisIt, 0);
+            ambientDice.vertices[basisIt].value[2] = CoCg(basisIt, 1);
         }
         
         return ambientDice;
     }
     
-    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresSRBF(ImageBase<vec3>& directions, const Image& irradiance)
+    AmbientDice ExperimentAmbientDice::solveAmbientDiceLeastSquaresSRBF(const SharedData& data, const Image& irradiance)
     {
+        PROBULATOR_TRACE_SCOPE("solveAmbientDiceLeastSquaresSRBF");
+        PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
         using namespace Eigen;
         
         AmbientDice ambientDice;
         
-        VectorXf momentsR = VectorXf::Zero(12);
-        VectorXf momentsG = VectorXf::Zero(12);
-        VectorXf momentsB = VectorXf::Zero(12);
-        
-        ivec2 imageSize = directions.getSize();
-        directions.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+        MatrixXf moments = data.parallelReduceTexels(MatrixXf(MatrixXf::Zero(12, 3)),
+                               [&](MatrixXf& accumulator, const vec3& direction, float texelArea, u32 texelIndex)
                                {
-                                   float texelArea = latLongTexelArea(pixelPos, imageSize);
-                                   
-                                   const vec4& color = irradiance.at(pixelPos);
+                                   const vec4& color = irradiance.at(texelIndex);
                                    
                                    float weights[12] = { 0.f };
                                    AmbientDice::srbfWeights(direction, weights);
                                    
                                    for (size_t i = 0; i < 12; i += 1)
                                    {
-                                       momentsR[i] += weights[i] * color.r * texelArea;
-                                       momentsG[i] += weights[i] * color.g * texelArea;
-                                       momentsB[i] += weights[i] * color.b * texelArea;
+                                       accumulator(i, 0) += weights[i] * color.r * texelArea;
+                                       accumulator(i, 1) += weights[i] * color.g * texelArea;
+                                       accumulator(i, 2) += weights[i] * color.b * texelArea;
                                        
                                    }
-                               });
-        
-        MatrixXf gram = AmbientDice::computeGramMatrixSRBF();
+                               }, [](const MatrixXf& a, const MatrixXf& b) -> MatrixXf { return a + b; });
         
-        const auto solver = gram.jacobiSvd(ComputeThinU | ComputeThinV);
-        VectorXf R = solver.solve(momentsR);
-        VectorXf G = solver.solve(momentsG);
-        VectorXf B = solver.solve(momentsB);
+        MatrixXf x = getGramSolverSRBF().solve(moments);
         
         for (u64 basisIt = 0; basisIt < 12; ++basisIt)
         {
-            ambientDice.vertices[basisIt].value[0] = R[basisIt];
-            ambientDice.vertices[basisIt].value[1] = G[basisIt];
-            ambientDice.vertices[basisIt].value[2] = B[basisIt];
+            ambientDice.vertices[basisIt].value[0] = x(basisIt, 0);
+            ambientDice.vertices[basisIt].value[1] = x(basisIt, 1);
+            ambientDice.vertices[basisIt].value[2] = x(basisIt, 2);
         }
         
         return ambientDice;
@@ -715,8 +703,8 @@ namespace Probulator {
         
         if (m_diceType == AmbientDiceTypeBezier)
         {
-            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresBezier(data.m_directionImage, m_input->m_radianceImage);
-            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresBezier(data.m_directionImage, m_input->m_irradianceImage);
+            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresBezier(data, m_input->m_radianceImage);
+            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresBezier(data, m_input->m_irradianceImage);
             
             data.m_directionImage.parallelForPixels2D([&](const vec3& direction, ivec2 pixelPos)
                                                       {
@@ -729,8 +717,8 @@ namespace Probulator {
         }
         else if (m_diceType == AmbientDiceTypeBezierYCoCg)
         {
-            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresBezierYCoCg(data.m_directionImage, m_input->m_radianceImage);
-            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresBezierYCoCg(data.m_directionImage, m_input->m_irradianceImage);
+            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresBezierYCoCg(data, m_input->m_radianceImage);
+            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresBezierYCoCg(data, m_input->m_irradianceImage);
             
             data.m_directionImage.parallelForPixels2D([&](const vec3& direction, ivec2 pixelPos)
                                                       {
@@ -743,8 +731,8 @@ namespace Probulator {
         }
         else if (m_diceType == AmbientDiceTypeSRBF)
         {
-            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresSRBF(data.m_directionImage, m_input->m_radianceImage);
-            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresSRBF(data.m_directionImage, m_input->m_irradianceImage);
+            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresSRBF(data, m_input->m_radianceImage);
+            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresSRBF(data, m_input->m_irradianceImage);
             
             data.m_directionImage.parallelForPixels2D([&](const vec3& direction, ivec2 pixelPos)
                                                       {
@@ -756,8 +744,8 @@ namespace Probulator {
                                                       });
         }  else if (m_diceType == AmbientDiceTypeLinear)
         {
-            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresLinear(data.m_directionImage, m_input->m_radianceImage);
-            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresLinear(data.m_directionImage, m_input->m_irradianceImage);
+            AmbientDice ambientDiceRadiance = solveAmbientDiceLeastSquaresLinear(data, m_input->m_radianceImage);
+            AmbientDice ambientDiceIrradiance = solveAmbientDiceLeastSquaresLinear(data, m_input->m_irradianceImage);
             
             data.m_directionImage.parallelForPixels2D([&](const vec3& direction, ivec2 pixelPos)
                                                       {
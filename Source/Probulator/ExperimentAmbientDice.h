@@ -207,10 +207,10 @@ namespace Probulator {
     {
         public:
         
-        static AmbientDice solveAmbientDiceLeastSquaresLinear(ImageBase<vec3>& directions, const Image& irradiance);
-        static AmbientDice solveAmbientDiceLeastSquaresBezier(ImageBase<vec3>& directions, const Image& irradiance);
-        static AmbientDice solveAmbientDiceLeastSquaresBezierYCoCg(ImageBase<vec3>& directions, const Image& irradiance);
-        static AmbientDice solveAmbientDiceLeastSquaresSRBF(ImageBase<vec3>& directions, const Image& irradiance);
+        static AmbientDice solveAmbientDiceLeastSquaresLinear(const SharedData& data, const Image& irradiance);
+        static AmbientDice solveAmbientDiceLeastSquaresBezier(const SharedData& data, const Image& irradiance);
+        static AmbientDice solveAmbientDiceLeastSquaresBezierYCoCg(const SharedData& data, const Image& irradiance);
+        static AmbientDice solveAmbientDiceLeastSquaresSRBF(const SharedData& data, const Image& irradiance);
         
         void run(SharedData& data) override;
         
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Probulator/Experiments.h>
+#include <Probulator/CosineConvolution.h>
+
+namespace Probulator {
+
+// Deterministic irradiance computed by convolving every texel of the environment with the clamped cosine lobe
+// of every output normal. Unlike Monte Carlo integration, the result contains no sampling noise or correlation
+// artifacts, which makes it suitable as the reference for other experiments.
+class ExperimentExactConvolution : public Experiment
+{
+public:
+
+    void run(SharedData& data) override
+    {
+        m_radianceImage = data.m_radianceImage;
+
+        // Every texel becomes one sample, weighted by its solid angle and the 1/pi irradiance normalization
+        const Image& sourceImage = m_fullResolutionEnabled ? data.m_sourceRadianceImage : data.m_radianceImage;
+        const ivec2 sourceSize = sourceImage.getSize();
+        RadianceSampleArray samples(sourceImage.getPixelCount());
+        for (int y = 0; y < sourceSize.y; ++y)
+        {
+            const float texelArea = latLongTexelArea(ivec2(0, y), sourceSize);
+            for (int x = 0; x < sourceSize.x; ++x)
+            {
+                const ivec2 pos = ivec2(x, y);
+                const u32 texelIndex = x + y * sourceSize.x;
+
+                RadianceSample sample;
+                sample.direction = latLongTexcoordToCartesian((vec2(pos) + vec2(0.5f)) / vec2(sourceSize));
+                sample.value = (vec3)sourceImage.at(texelIndex) * (texelArea / pi);
+                samples.set(texelIndex, sample);
+            }
+        }
+
+        m_irradianceImage = Image(data.m_outputSize);
+
+        const u32 width = data.m_outputSize.x;
+        parallelForRange(0u, (u32)data.m_outputSize.y, 1, [&](const ParallelRange& range)
+        {
+            const u32 texelBegin = range.begin * width;
+            const u32 texelCount = (range.end - range.begin) * width;
+
+            std::vector<float> irradianceR(texelCount);
+            std::vector<float> irradianceG(texelCount);
+            std::vector<float> irradianceB(texelCount);
+
+            cosineConvolveBatch(samples,
+                &data.m_directions.x[texelBegin], &data.m_directions.y[texelBegin], &data.m_directions.z[texelBegin], texelCount,
+                irradianceR.data(), irradianceG.data(), irradianceB.data());
+
+            for (u32 i = 0; i < texelCount; ++i)
+            {
+                m_irradianceImage.at(texelBegin + i) = vec4(irradianceR[i], irradianceG[i], irradianceB[i], 1.0f);
+            }
+        });
+
+        // Only the ground truth experiment publishes irradiance samples (see ExperimentMCIS)
+        if (m_useAsReference)
+        {
+            data.GenerateIrradianceSamples(m_irradianceImage);
+        }
+    }
+
+    void getProperties(std::vector<Property>& outProperties) override
+    {
+        Experiment::getProperties(outProperties);
+        outProperties.push_back(Property("Full resolution", &m_fullResolutionEnabled));
+    }
+
+    // Convolve the original resolution input instead of the image resized to the output resolution.
+    // Cost is proportional to the number of input texels.
+    ExperimentExactConvolution& setFullResolutionEnabled(bool state)
+    {
+        m_fullResolutionEnabled = state;
+        return *this;
+    }
+
+    bool m_fullResolutionEnabled = false;
+};
+
+}
@@ -11,32 +11,26 @@ public:
 
     void run(SharedData& data) override
     {
-        HBasisT<vec3, L> hRadiance = {};
+        HBasisRunningAverageState<L> radianceState;
+        radianceState.addSamples(data.m_radianceSamples);
+        HBasisT<vec3, L> hRadiance = radianceState.snapshot();
         const u32 sampleCount = (u32)data.m_radianceSamples.size();
-        for (const RadianceSample& sample : data.m_radianceSamples)
-        {
-            hAddWeighted(hRadiance, hEvaluate<L>(sample.direction), sample.value * (fourPi / sampleCount));
-        }
 
         HBasisT<vec3, L> hIrradiance = {};
-        for (const RadianceSample& sample : data.m_irradianceSamples)
+        for (u32 sampleIt = 0; sampleIt < data.m_irradianceSamples.size(); ++sampleIt)
         {
+            const RadianceSample sample = data.m_irradianceSamples[sampleIt];
             hAddWeighted(hIrradiance, hEvaluate<L>(sample.direction), sample.value * (fourPi / sampleCount));
         }
 
-        m_radianceImage = Image(data.m_outputSize);
-        m_irradianceImage = Image(data.m_outputSize);
-
-        data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+        Eigen::MatrixXf radianceCoefficients(hSize(L), 3);
+        for (size_t i = 0; i < hSize(L); ++i)
         {
-            HBasisT<float, L> directionH = hEvaluate<L>(direction);
-
-            vec3 sampleH = max(vec3(0.0f), hDot(hRadiance, directionH));
-            m_radianceImage.at(pixelPos) = vec4(sampleH, 1.0f);
+            radianceCoefficients.row(i) << hRadiance[i].x, hRadiance[i].y, hRadiance[i].z;
+        }
 
-            vec3 sampleIrradianceH = max(vec3(0.0f), hDot(hRadiance, directionH));
-            m_irradianceImage.at(pixelPos) = vec4(sampleIrradianceH, 1.0f);
-        });
+        m_radianceImage = data.reconstructImage(BasisType_H, L, radianceCoefficients);
+        m_irradianceImage = m_radianceImage; // irradiance is reconstructed from radiance coefficients
     }
 };
 
@@ -1,9 +1,63 @@
 #pragma once
 
 #include <Probulator/Experiments.h>
+#include <Probulator/HierarchicalDistribution.h>
+
+#include <numeric>
 
 namespace Probulator {
 
+// Adaptive sampling state shared by the Monte Carlo experiments.
+// Each pixel stops taking samples once the relative standard error of its luminance estimate
+// drops below the target. The regular sample count of the experiment is used as a hard cap.
+struct MonteCarloAdaptiveSampling
+{
+    bool m_enabled = false;
+    float m_targetRelativeError = 0.01f;
+    u32 m_minSampleCount = 64; // guards against stopping early on a run of similar samples
+    u32 m_checkInterval = 16;
+
+    ImageBase<u32> m_sampleCountImage; // number of samples taken for each pixel in the last run
+
+    bool isConverged(const OnlineVariance<float>& luminance) const
+    {
+        if (luminance.n < (int)m_minSampleCount || luminance.n % m_checkInterval != 0)
+        {
+            return false;
+        }
+
+        return luminance.getStandardError() <= m_targetRelativeError * abs(luminance.mean);
+    }
+
+    void printSummary(const std::string& name, u32 sampleCap) const
+    {
+        u64 totalSampleCount = 0;
+        u32 minSampleCount = ~0u;
+        u32 maxSampleCount = 0;
+        for (u32 sampleCount : m_sampleCountImage)
+        {
+            totalSampleCount += sampleCount;
+            minSampleCount = min(minSampleCount, sampleCount);
+            maxSampleCount = max(maxSampleCount, sampleCount);
+        }
+
+        u32 pixelCount = m_sampleCountImage.getPixelCount();
+        u64 maxTotalSampleCount = (u64)pixelCount * sampleCap;
+        double savedPercent = 100.0 * (double)(maxTotalSampleCount - totalSampleCount) / (double)max<u64>(maxTotalSampleCount, 1);
+
+        printf("%s: adaptive sampling took %llu of %llu samples (%.1f%% saved), per pixel min %u, mean %.1f, max %u\n",
+            name.c_str(), (unsigned long long)totalSampleCount, (unsigned long long)maxTotalSampleCount, savedPercent,
+            minSampleCount, (double)totalSampleCount / max(pixelCount, 1u), maxSampleCount);
+    }
+
+    void getProperties(std::vector<Experiment::Property>& outProperties)
+    {
+        outProperties.push_back(Experiment::Property("Adaptive sampling", &m_enabled));
+        outProperties.push_back(Experiment::Property("Target relative error", &m_targetRelativeError));
+        outProperties.push_back(Experiment::Property("Min sample count", reinterpret_cast<int*>(&m_minSampleCount)));
+    }
+};
+
 class ExperimentMC : public Experiment
 {
 public:
@@ -13,6 +67,14 @@ public:
         m_radianceImage = data.m_radianceImage;
 
         m_irradianceImage = Image(data.m_outputSize);
+
+        if (m_adaptive.m_enabled)
+        {
+            computeIrradianceAdaptive(data);
+            m_adaptive.printSummary(m_name, m_hemisphereSampleCount);
+            return;
+        }
+
         data.m_directionImage.parallelForPixels2D([&](const vec3& direction, ivec2 pixelPos)
         {
             mat3 basis = makeOrthogonalBasis(direction);
@@ -31,69 +93,380 @@ public:
         });
     }
 
+    // Hammersley points depend on the total sample count, so the adaptive path uses
+    // the progressive Halton sequence instead, which stays well distributed at any prefix length.
+    void computeIrradianceAdaptive(SharedData& data)
+    {
+        m_adaptive.m_sampleCountImage = ImageBase<u32>(data.m_outputSize);
+
+        data.m_directionImage.parallelForPixels2D([&](const vec3& direction, ivec2 pixelPos)
+        {
+            mat3 basis = makeOrthogonalBasis(direction);
+            vec3 accum = vec3(0.0f);
+            OnlineVariance<float> luminance;
+            u32 sampleIt = 0;
+            while (sampleIt < m_hemisphereSampleCount)
+            {
+                vec2 sampleUv = vec2(sampleHalton(sampleIt + 1, 2), sampleHalton(sampleIt + 1, 3));
+                vec3 hemisphereDirection = sampleCosineHemisphere(sampleUv);
+                vec3 sampleDirection = basis * hemisphereDirection;
+                vec3 sampleValue = (vec3)m_radianceImage.sampleNearest(cartesianToLatLongTexcoord(sampleDirection));
+                accum += sampleValue;
+                luminance.addSample(rgbLuminance(sampleValue));
+                ++sampleIt;
+
+                if (m_adaptive.isConverged(luminance))
+                {
+                    break;
+                }
+            }
+
+            accum /= sampleIt;
+
+            m_irradianceImage.at(pixelPos) = vec4(accum, 1.0f);
+            m_adaptive.m_sampleCountImage.at(pixelPos) = sampleIt;
+        });
+    }
+
 	void getProperties(std::vector<Property>& outProperties) override
 	{
 		Experiment::getProperties(outProperties);
 		outProperties.push_back(Property("Hemisphere sample count", reinterpret_cast<int*>(&m_hemisphereSampleCount)));
+		m_adaptive.getProperties(outProperties);
 	}
 
     ExperimentMC& setHemisphereSampleCount(u32 v) { m_hemisphereSampleCount = v; return *this; }
 
+    // Hemisphere sample count becomes the per-pixel cap when adaptive sampling is enabled
+    ExperimentMC& setAdaptiveSampling(bool enabled, float targetRelativeError = 0.01f)
+    {
+        m_adaptive.m_enabled = enabled;
+        m_adaptive.m_targetRelativeError = targetRelativeError;
+        return *this;
+    }
+
     u32 m_hemisphereSampleCount = 1000;
+    MonteCarloAdaptiveSampling m_adaptive;
 };
 
 class ExperimentMCIS : public Experiment
 {
 public:
 
-    void run(SharedData& data) override
+    static const u32 BatchSize = 256;
+
+    // Importance sample of the environment, with radiance multiplied by the solid angle of the sampled texel
+    struct Sample
     {
-        const ivec2 imageSize = data.m_outputSize;
+        vec3 direction;
+        vec3 radiance;
+        float probability;
+    };
 
-        m_radianceImage = data.m_radianceImage;
+    // Draws texels of the output resolution radiance image proportionally to luminance * solid angle
+    struct OutputResolutionSampler
+    {
+        OutputResolutionSampler(const SharedData& data)
+            : m_data(data)
+            , m_texelWeights(computeTexelWeights(data))
+            , m_weightSum(std::accumulate(m_texelWeights.begin(), m_texelWeights.end(), 0.0f))
+            , m_distribution(m_texelWeights.data(), m_texelWeights.size(), m_weightSum)
+        {
+        }
 
-        std::vector<float> texelWeights;
-        std::vector<float> texelAreas;
-        float weightSum = 0.0;
-        m_radianceImage.forPixels2D([&](const vec4& p, ivec2 pixelPos)
+        static std::vector<float> computeTexelWeights(const SharedData& data)
         {
-            float area = latLongTexelArea(pixelPos, imageSize);
+            std::vector<float> texelWeights(data.m_radianceImage.getPixelCount());
+            for (u32 texelIndex = 0; texelIndex < (u32)texelWeights.size(); ++texelIndex)
+            {
+                float area = data.getTexelArea(texelIndex);
+                float intensity = rgbLuminance((vec3)data.m_radianceImage.at(texelIndex));
+                texelWeights[texelIndex] = intensity * area;
+            }
+            return texelWeights;
+        }
 
-			float intensity = rgbLuminance((vec3)p);
-            float weight = intensity * area;
+        template <typename Rng>
+        Sample operator()(Rng& rng) const
+        {
+            return getSample(m_distribution(rng));
+        }
 
-            weightSum += weight;
-            texelWeights.push_back(weight);
-            texelAreas.push_back(area);
-        });
+        template <typename Rng>
+        void sampleBatch(u32 count, Sample* out, Rng& rng) const
+        {
+            u32 sampleIndices[BatchSize];
+            for (u32 batchBegin = 0; batchBegin < count; batchBegin += BatchSize)
+            {
+                const u32 batchCount = min(BatchSize, count - batchBegin);
+                m_distribution.sampleBatch(batchCount, sampleIndices, rng);
+                for (u32 i = 0; i < batchCount; ++i)
+                {
+                    out[batchBegin + i] = getSample(sampleIndices[i]);
+                }
+            }
+        }
+
+        Sample getSample(u32 sampleIndex) const
+        {
+            Sample sample;
+            sample.direction = m_data.m_directions.get(sampleIndex);
+            sample.radiance = (vec3)m_data.m_radianceImage.at(sampleIndex) * m_data.getTexelArea(sampleIndex);
+            sample.probability = m_texelWeights[sampleIndex] / m_weightSum;
+            return sample;
+        }
+
+        const SharedData& m_data;
+        std::vector<float> m_texelWeights;
+        float m_weightSum;
+        DiscreteDistribution<float> m_distribution;
+    };
+
+    // Draws texels of the original resolution input image, so small bright sources are not smeared
+    // by resizing to the output resolution. Uses a hierarchical distribution, which needs far less memory
+    // than an alias table at high resolutions.
+    struct SourceResolutionSampler
+    {
+        SourceResolutionSampler(const SharedData& data)
+            : m_image(data.m_sourceRadianceImage)
+            , m_texelAreaByRow(computeTexelAreaByRow(m_image.getSize()))
+            , m_distribution(computeTexelWeights(m_image, m_texelAreaByRow).data(), m_image.getSize())
+        {
+        }
 
-        DiscreteDistribution<float> discreteDistribution(texelWeights.data(), texelWeights.size(), weightSum);
+        static std::vector<float> computeTexelAreaByRow(ivec2 size)
+        {
+            std::vector<float> texelAreaByRow(size.y);
+            for (int y = 0; y < size.y; ++y)
+            {
+                texelAreaByRow[y] = latLongTexelArea(ivec2(0, y), size);
+            }
+            return texelAreaByRow;
+        }
 
+        static std::vector<float> computeTexelWeights(const Image& image, const std::vector<float>& texelAreaByRow)
+        {
+            std::vector<float> texelWeights(image.getPixelCount());
+            for (u32 texelIndex = 0; texelIndex < (u32)texelWeights.size(); ++texelIndex)
+            {
+                float area = texelAreaByRow[texelIndex / image.getWidth()];
+                float intensity = rgbLuminance((vec3)image.at(texelIndex));
+                texelWeights[texelIndex] = intensity * area;
+            }
+            return texelWeights;
+        }
+
+        template <typename Rng>
+        Sample operator()(Rng& rng) const
+        {
+            float probability;
+            u32 sampleIndex = m_distribution(rng, probability);
+            ivec2 pos = ivec2(sampleIndex % m_image.getWidth(), sampleIndex / m_image.getWidth());
+
+            Sample sample;
+            sample.direction = latLongTexcoordToCartesian((vec2(pos) + vec2(0.5f)) / vec2(m_image.getSize()));
+            sample.radiance = (vec3)m_image.at(sampleIndex) * m_texelAreaByRow[pos.y];
+            sample.probability = probability;
+            return sample;
+        }
+
+        template <typename Rng>
+        void sampleBatch(u32 count, Sample* out, Rng& rng) const
+        {
+            for (u32 i = 0; i < count; ++i)
+            {
+                out[i] = (*this)(rng);
+            }
+        }
+
+        const Image& m_image;
+        std::vector<float> m_texelAreaByRow;
+        HierarchicalDistribution m_distribution;
+    };
+
+    void run(SharedData& data) override
+    {
+        m_radianceImage = data.m_radianceImage;
         m_irradianceImage = Image(data.m_outputSize);
+
+        if (m_fullResolutionEnabled)
+        {
+            computeIrradiance(data, SourceResolutionSampler(data));
+        }
+        else
+        {
+            computeIrradiance(data, OutputResolutionSampler(data));
+        }
+
+        // Only the ground truth experiment publishes irradiance samples, since dependent
+        // experiments may be reading them while other experiments are still running.
+        if (m_useAsReference)
+        {
+            data.GenerateIrradianceSamples(m_irradianceImage);
+        }
+    }
+
+    template <typename Sampler>
+    void computeIrradiance(SharedData& data, const Sampler& sampler)
+    {
+        if (m_adaptive.m_enabled)
+        {
+            computeIrradianceAdaptive(data, sampler);
+            m_adaptive.printSummary(m_name, m_sampleCount);
+        }
+        else if (m_jitterEnabled)
+        {
+            computeIrradianceJittered(data, sampler);
+        }
+        else
+        {
+            computeIrradianceSharedSamples(data, sampler);
+        }
+    }
+
+    // Every pixel draws its own sample sequence from a stream keyed by the pixel index, in batches that are evaluated after drawing
+    template <typename Sampler>
+    void computeIrradianceJittered(SharedData& data, const Sampler& sampler)
+    {
         data.m_directionImage.parallelForPixels2D([&](const vec3& normal, ivec2 pixelPos)
         {
             u32 pixelIndex = pixelPos.x + pixelPos.y * m_irradianceImage.getWidth();
-            u32 seed = m_jitterEnabled ? pixelIndex : 0;
-            std::mt19937 rng(seed);
+            RandomStream rng(getRandomSeed(), pixelIndex);
 
+            Sample samples[BatchSize];
             vec3 accum = vec3(0.0f);
-            for (u32 sampleIt = 0; sampleIt < m_sampleCount; ++sampleIt)
+            for (u32 batchBegin = 0; batchBegin < m_sampleCount; batchBegin += BatchSize)
             {
-                u32 sampleIndex = (u32)discreteDistribution(rng);
-                float sampleProbability = texelWeights[sampleIndex] / weightSum;
-                vec3 sampleDirection = data.m_directionImage.at(sampleIndex);
-                float cosTerm = dotMax0(normal, sampleDirection);
-                float sampleArea = (float)texelAreas[sampleIndex];
-                vec3 sampleRadiance = (vec3)m_radianceImage.at(sampleIndex) * sampleArea;
-                accum += sampleRadiance * cosTerm / sampleProbability;
+                const u32 batchCount = min(BatchSize, m_sampleCount - batchBegin);
+                sampler.sampleBatch(batchCount, samples, rng);
+                for (u32 i = 0; i < batchCount; ++i)
+                {
+                    const Sample& sample = samples[i];
+                    float cosTerm = dotMax0(normal, sample.direction);
+                    accum += sample.radiance * cosTerm / sample.probability;
+                }
             }
 
             accum /= m_sampleCount * pi;
 
             m_irradianceImage.at(pixelPos) = vec4(accum, 1.0f);
         });
+    }
+
+    // Each pixel draws samples until its estimate converges or the sample count cap is reached.
+    // Without jitter, every pixel walks a prefix of the same sample sequence.
+    template <typename Sampler>
+    void computeIrradianceAdaptive(SharedData& data, const Sampler& sampler)
+    {
+        std::vector<Sample> sharedSamples;
+        if (!m_jitterEnabled)
+        {
+            sharedSamples.resize(m_sampleCount);
+            Pcg32 rng(0);
+            sampler.sampleBatch(m_sampleCount, sharedSamples.data(), rng);
+        }
+
+        m_adaptive.m_sampleCountImage = ImageBase<u32>(data.m_outputSize);
+
+        data.m_directionImage.parallelForPixels2D([&](const vec3& normal, ivec2 pixelPos)
+        {
+            u32 pixelIndex = pixelPos.x + pixelPos.y * m_irradianceImage.getWidth();
+            RandomStream rng(getRandomSeed(), pixelIndex);
+
+            vec3 accum = vec3(0.0f);
+            OnlineVariance<float> luminance;
+            u32 sampleIt = 0;
+            while (sampleIt < m_sampleCount)
+            {
+                Sample sample = m_jitterEnabled ? sampler(rng) : sharedSamples[sampleIt];
+                float cosTerm = dotMax0(normal, sample.direction);
+                vec3 sampleValue = sample.radiance * cosTerm / sample.probability;
+                accum += sampleValue;
+                luminance.addSample(rgbLuminance(sampleValue));
+                ++sampleIt;
+
+                if (m_adaptive.isConverged(luminance))
+                {
+                    break;
+                }
+            }
+
+            accum /= sampleIt * pi;
+
+            m_irradianceImage.at(pixelPos) = vec4(accum, 1.0f);
+            m_adaptive.m_sampleCountImage.at(pixelPos) = sampleIt;
+        });
+    }
+
+    // Without jitter every pixel would draw the same sample sequence, so it is drawn once and the estimate
+    // becomes a dense clamped-cosine product between pixel normals and samples. Each row of pixels is
+    // processed as a block with pixels in the inner loop, which keeps per-pixel summation order
+    // (and therefore results) identical to evaluating pixels one by one.
+    template <typename Sampler>
+    void computeIrradianceSharedSamples(SharedData& data, const Sampler& sampler)
+    {
+        std::vector<float> sampleDirectionX(m_sampleCount);
+        std::vector<float> sampleDirectionY(m_sampleCount);
+        std::vector<float> sampleDirectionZ(m_sampleCount);
+        std::vector<vec3> sampleRadiance(m_sampleCount);
+        std::vector<float> sampleProbability(m_sampleCount);
+
+        std::vector<Sample> samples(m_sampleCount);
+        Pcg32 rng(0);
+        sampler.sampleBatch(m_sampleCount, samples.data(), rng);
+        for (u32 sampleIt = 0; sampleIt < m_sampleCount; ++sampleIt)
+        {
+            const Sample& sample = samples[sampleIt];
+            sampleDirectionX[sampleIt] = sample.direction.x;
+            sampleDirectionY[sampleIt] = sample.direction.y;
+            sampleDirectionZ[sampleIt] = sample.direction.z;
+            sampleRadiance[sampleIt] = sample.radiance;
+            sampleProbability[sampleIt] = sample.probability;
+        }
 
-        data.GenerateIrradianceSamples(m_irradianceImage);
+        const u32 width = data.m_outputSize.x;
+        parallelForRange(0u, (u32)data.m_outputSize.y, 1, [&](const ParallelRange& range)
+        {
+            std::vector<float> accumR(width);
+            std::vector<float> accumG(width);
+            std::vector<float> accumB(width);
+
+            for (u32 y = range.begin; y != range.end; ++y)
+            {
+                const u32 rowBegin = y * width;
+                const float* normalX = &data.m_directions.x[rowBegin];
+                const float* normalY = &data.m_directions.y[rowBegin];
+                const float* normalZ = &data.m_directions.z[rowBegin];
+
+                std::fill(accumR.begin(), accumR.end(), 0.0f);
+                std::fill(accumG.begin(), accumG.end(), 0.0f);
+                std::fill(accumB.begin(), accumB.end(), 0.0f);
+
+                for (u32 sampleIt = 0; sampleIt < m_sampleCount; ++sampleIt)
+                {
+                    const float dx = sampleDirectionX[sampleIt];
+                    const float dy = sampleDirectionY[sampleIt];
+                    const float dz = sampleDirectionZ[sampleIt];
+                    const vec3 radiance = sampleRadiance[sampleIt];
+                    const float probability = sampleProbability[sampleIt];
+
+                    for (u32 x = 0; x < width; ++x)
+                    {
+                        float cosTerm = max(0.0f, normalX[x] * dx + normalY[x] * dy + normalZ[x] * dz);
+                        accumR[x] += radiance.r * cosTerm / probability;
+                        accumG[x] += radiance.g * cosTerm / probability;
+                        accumB[x] += radiance.b * cosTerm / probability;
+                    }
+                }
+
+                for (u32 x = 0; x < width; ++x)
+                {
+                    vec3 accum = vec3(accumR[x], accumG[x], accumB[x]);
+                    accum /= m_sampleCount * pi;
+                    m_irradianceImage.at(rowBegin + x) = vec4(accum, 1.0f);
+                }
+            }
+        });
     }
 
 	void getProperties(std::vector<Property>& outProperties) override
@@ -101,6 +474,8 @@ public:
 		Experiment::getProperties(outProperties);
 		outProperties.push_back(Property("Sample count", reinterpret_cast<int*>(&m_sampleCount)));
 		outProperties.push_back(Property("Jitter enabled", &m_jitterEnabled));
+		outProperties.push_back(Property("Full resolution", &m_fullResolutionEnabled));
+		m_adaptive.getProperties(outProperties);
 	}
 
     ExperimentMCIS& setSampleCount(u32 v)
@@ -115,8 +490,25 @@ public:
         return *this;
     }
 
+    // Sample the original resolution input instead of the image resized to the output resolution
+    ExperimentMCIS& setFullResolutionEnabled(bool state)
+    {
+        m_fullResolutionEnabled = state;
+        return *this;
+    }
+
+    // Sample count becomes the per-pixel cap when adaptive sampling is enabled
+    ExperimentMCIS& setAdaptiveSampling(bool enabled, float targetRelativeError = 0.01f)
+    {
+        m_adaptive.m_enabled = enabled;
+        m_adaptive.m_targetRelativeError = targetRelativeError;
+        return *this;
+    }
+
     u32 m_sampleCount = 1000;
     bool m_jitterEnabled = false;
+    bool m_fullResolutionEnabled = false;
+    MonteCarloAdaptiveSampling m_adaptive;
 };
 
 }
\ No newline at end of file
@@ -33,10 +33,16 @@ public:
         return *this;
     }
 
+    ExperimentSGBase& setCullingThreshold(float threshold)
+    {
+        m_cullingThreshold = threshold;
+        return *this;
+    }
+
     void run(SharedData& data) override
     {
         generateLobes();
-        solveForRadiance(data.m_radianceSamples);
+        solve(data);
         generateRadianceImage(data);
         generateIrradianceImage(data);
     }
@@ -48,6 +54,7 @@ public:
 		outProperties.push_back(Property("Ambient lobe enabled", &m_ambientLobeEnabled));
 		outProperties.push_back(Property("Lambda", &m_lambda));
 		outProperties.push_back(Property("BRDF Lambda", &m_brdfLambda));
+		outProperties.push_back(Property("Culling threshold", &m_cullingThreshold));
 	}
 
     bool m_nonNegativeSolve = false;
@@ -55,11 +62,17 @@ public:
     u32 m_lobeCount = 1;
     float m_lambda = 0.0f;
     float m_brdfLambda = 0.0f; // 0 to use a curve fit for irradiance.
+    float m_cullingThreshold = 1e-5f; // lobes are skipped where they contribute less, relative to the sum of lobe peaks (see SgBasisCones)
     SgBasis m_lobes;
 
 protected:
 
-    virtual void solveForRadiance(const std::vector<RadianceSample>& radianceSamples) = 0;
+    virtual void solveForRadiance(const RadianceSampleArray& radianceSamples) = 0;
+
+    virtual void solve(const SharedData& data)
+    {
+        solveForRadiance(data.m_radianceSamples);
+    }
 
     void generateLobes()
     {
@@ -85,14 +98,49 @@ protected:
         }
     }
 
+    // Texel rows are split into tiles of directions, each reconstructed only from lobes that contribute to it.
+    // Tiles fill whole AVX-512 registers in sgEvaluateSumBatch.
+    static const u32 ReconstructionTileSize = 16;
+
+    struct ReconstructionContext
+    {
+        std::vector<u32> tileLobeIndices;
+        SgBasis tileLobes;
+        float tile[3][ReconstructionTileSize];
+    };
+
     void generateRadianceImage(const SharedData& data)
     {
         m_radianceImage = Image(data.m_outputSize);
-        m_radianceImage.forPixels2D([&](vec4& pixel, ivec2 pixelPos)
+
+        const SgBasisCones cones = sgBasisRadianceCones(m_lobes, m_cullingThreshold);
+        const u32 width = data.m_outputSize.x;
+
+        parallelForWithContext<ReconstructionContext>(0u, (u32)data.m_outputSize.y, 1, [&](ReconstructionContext& context, u32 rowIt)
         {
-            vec3 direction = data.m_directionImage.at(pixelPos);
-            vec3 sampleSg = sgBasisEvaluate(m_lobes, direction);
-            pixel = vec4(sampleSg, 1.0f);
+            const u32 rowEnd = (rowIt + 1) * width;
+            for (u32 tileBegin = rowIt * width; tileBegin < rowEnd; tileBegin += ReconstructionTileSize)
+            {
+                const u32 tileSize = std::min(ReconstructionTileSize, rowEnd - tileBegin);
+                const float* directionX = &data.m_directions.x[tileBegin];
+                const float* directionY = &data.m_directions.y[tileBegin];
+                const float* directionZ = &data.m_directions.z[tileBegin];
+
+                sgBasisCullLobes(m_lobes, cones, directionX, directionY, directionZ, tileSize, context.tileLobeIndices);
+                context.tileLobes.clear();
+                for (u32 lobeIt : context.tileLobeIndices)
+                {
+                    context.tileLobes.push_back(m_lobes[lobeIt]);
+                }
+
+                sgEvaluateSumBatch(context.tileLobes.data(), (u32)context.tileLobes.size(), directionX, directionY, directionZ, tileSize,
+                    context.tile[0], context.tile[1], context.tile[2]);
+
+                for (u32 i = 0; i < tileSize; ++i)
+                {
+                    m_radianceImage.at(tileBegin + i) = vec4(context.tile[0][i], context.tile[1][i], context.tile[2][i], 1.0f);
+                }
+            }
         });
     }
 
@@ -103,29 +151,52 @@ protected:
         brdf.mu = vec3(sgFindMu(brdf.lambda, pi));
         
         m_irradianceImage = Image(data.m_outputSize);
-        
-        // If the BRDF lambda is greater than 0, use a SG for the BRDF.
-        // Otherwise, use a curve fit.
-        if (m_brdfLambda > 0.f)
+
+        const SgBasisCones cones = sgBasisIrradianceCones(m_lobes, m_brdfLambda, m_cullingThreshold);
+        const u32 width = data.m_outputSize.x;
+
+        std::vector<SgIrradianceFittedLobe> fittedLobes;
+        for (const SphericalGaussian& lobe : m_lobes)
         {
-            m_irradianceImage.forPixels2D([&](vec4& pixel, ivec2 pixelPos)
-                                          {
-                                              brdf.p = data.m_directionImage.at(pixelPos);
-                                              vec3 sampleSg = sgBasisDot(m_lobes, brdf) / pi;
-                                              pixel = vec4(sampleSg, 1.0f);
-                                          });
+            fittedLobes.push_back(sgIrradianceFittedPrepare(lobe));
         }
-        else
+
+        parallelForWithContext<ReconstructionContext>(0u, (u32)data.m_outputSize.y, 1, [&](ReconstructionContext& context, u32 rowIt)
         {
-            m_irradianceImage.forPixels2D([&](vec4& pixel, ivec2 pixelPos)
-                                          {
-                                              vec3 normal = data.m_directionImage.at(pixelPos);
-                                              vec3 sampleSg = sgBasisIrradianceFitted(m_lobes, normal);
-                                              pixel = vec4(sampleSg, 1.0f);
-                                          });
-        }
-        
-       
+            const u32 rowEnd = (rowIt + 1) * width;
+            for (u32 tileBegin = rowIt * width; tileBegin < rowEnd; tileBegin += ReconstructionTileSize)
+            {
+                const u32 tileSize = std::min(ReconstructionTileSize, rowEnd - tileBegin);
+                sgBasisCullLobes(m_lobes, cones, &data.m_directions.x[tileBegin], &data.m_directions.y[tileBegin],
+                    &data.m_directions.z[tileBegin], tileSize, context.tileLobeIndices);
+
+                for (u32 texelIndex = tileBegin; texelIndex != tileBegin + tileSize; ++texelIndex)
+                {
+                    const vec3 normal = data.m_directions.get(texelIndex);
+                    vec3 sampleSg = vec3(0.0f);
+
+                    // If the BRDF lambda is greater than 0, use a SG for the BRDF.
+                    // Otherwise, use a curve fit.
+                    if (m_brdfLambda > 0.f)
+                    {
+                        SphericalGaussian texelBrdf = brdf;
+                        texelBrdf.p = normal;
+                        for (u32 lobeIt : context.tileLobeIndices)
+                        {
+                            sampleSg += sgDot(m_lobes[lobeIt], texelBrdf);
+                        }
+                    }
+                    else
+                    {
+                        for (u32 lobeIt : context.tileLobeIndices)
+                        {
+                            sampleSg += sgIrradianceFitted(fittedLobes[lobeIt], normal);
+                        }
+                    }
+                    m_irradianceImage.at(texelIndex) = vec4(sampleSg / pi, 1.0f);
+                }
+            }
+        });
     }
 };
 
@@ -133,14 +204,15 @@ class ExperimentSGNaive : public ExperimentSGBase
 {
 public:
 
-    void solveForRadiance(const std::vector<RadianceSample>& radianceSamples) override
+    void solveForRadiance(const RadianceSampleArray& radianceSamples) override
     {
         const u32 lobeCount = (u32)m_lobes.size();
         const u32 sampleCount = (u32)radianceSamples.size();
         const float normFactor = sgBasisNormalizationFactor(m_lambda, lobeCount);
 
-        for (const RadianceSample& sample : radianceSamples)
+        for (u32 sampleIt = 0; sampleIt < sampleCount; ++sampleIt)
         {
+            const RadianceSample sample = radianceSamples[sampleIt];
             for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
             {
                 const SphericalGaussian& sg = m_lobes[lobeIt];
@@ -156,113 +228,156 @@ class ExperimentSGRunningAverage : public ExperimentSGBase
 {
 public:
     
-    void solveForRadiance(const std::vector<RadianceSample>& radianceSamples) override
+    void solveForRadiance(const RadianceSampleArray& radianceSamples) override
     {
-        const u32 lobeCount = (u32)m_lobes.size();
+        SgRunningAverageState state(m_lobes, m_nonNegativeSolve);
+        state.addSamples(radianceSamples);
+        m_lobes = state.snapshot();
+    }
+};
 
-        std::vector<float> lobeMCSphericalIntegrals(lobeCount, 0.0f);
+// Least squares fits can optionally stream samples generated on the fly into normal equations
+// instead of building the design matrix from the shared radiance samples.
+// Memory use then only depends on the lobe count, which allows fitting to millions of samples.
+class ExperimentSGLeastSquaresBase : public ExperimentSGBase
+{
+public:
 
-        std::vector<float> lobePrecomputedSphericalIntegrals(lobeCount);
-        for (u64 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
-        {
-            lobePrecomputedSphericalIntegrals[lobeIt] = (1.f - exp(-4.f * m_lobes[lobeIt].lambda)) / (4 * m_lobes[lobeIt].lambda);
-        }
+    ExperimentSGLeastSquaresBase& setStreamingSampleCount(u32 sampleCount)
+    {
+        m_streamingSampleCount = sampleCount;
+        return *this;
+    }
 
-        float totalSampleWeight = 0.f;
+    void getProperties(std::vector<Property>& outProperties) override
+    {
+        ExperimentSGBase::getProperties(outProperties);
+        outProperties.push_back(Property("Streaming sample count", reinterpret_cast<int*>(&m_streamingSampleCount)));
+    }
 
-        std::vector<float> sampleLobeWeights(lobeCount);
+    u32 m_streamingSampleCount = 0; // 0 to fit the shared radiance samples
 
-        for (const RadianceSample& sample : radianceSamples) {
-            const float sampleWeight = 1.f;
-            totalSampleWeight += sampleWeight;
-            float sampleWeightScale = sampleWeight / totalSampleWeight;
+protected:
 
-            vec3 currentEstimate = vec3(0.f);
+    virtual SgBasis solveNormalEquations(const SgNormalEquations& equations) = 0;
 
-            for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt) {
-                float dotProduct = dot(m_lobes[lobeIt].p, sample.direction);
-                float weight = exp(m_lobes[lobeIt].lambda * (dotProduct - 1.0f));
-                currentEstimate += m_lobes[lobeIt].mu * weight;
+    void solve(const SharedData& data) override
+    {
+        if (m_streamingSampleCount == 0)
+        {
+            solveForRadiance(data.m_radianceSamples);
+            return;
+        }
 
-                sampleLobeWeights[lobeIt] = weight;
-            }
+        SgNormalEquations equations = sgAccumulateNormalEquations(m_lobes, m_streamingSampleCount, [&](u32 sampleIt)
+        {
+            return data.generateSample(sampleIt, data.m_radianceImage);
+        });
 
-            for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt) {
-                float weight = sampleLobeWeights[lobeIt];
-                if (weight == 0.f) { continue; }
-
-                float sphericalIntegralGuess = weight * weight;
-                
-                // Update the MC-computed integral of the lobe over the domain.
-                lobeMCSphericalIntegrals[lobeIt] += (sphericalIntegralGuess - lobeMCSphericalIntegrals[lobeIt]) * sampleWeightScale;
-                
-                // The most accurate method requires using the MC-computed integral,
-                // since then bias in the estimate will partially cancel out.
-                // However, if you don't want to store a weight per-lobe you can instead substitute it with the
-                // precomputed integral at a slight increase in error.
-                
-                // Clamp the MC-computed integral to within a reasonable ad-hoc factor of the actual integral to avoid noise.
-                float sphericalIntegral = max(lobeMCSphericalIntegrals[lobeIt], lobePrecomputedSphericalIntegrals[lobeIt] * 0.75f);
-                
-                vec3 otherLobesContribution = currentEstimate - m_lobes[lobeIt].mu * weight;
-                vec3 newValue = (sample.value - otherLobesContribution) * weight / sphericalIntegral;
-                
-                m_lobes[lobeIt].mu += (newValue - m_lobes[lobeIt].mu) * sampleWeightScale;
-
-                if (m_nonNegativeSolve) {
-                    m_lobes[lobeIt].mu = max(m_lobes[lobeIt].mu, vec3(0.f));
-                }
-            }
-        }
+        m_lobes = solveNormalEquations(equations);
     }
 };
 
-class ExperimentSGLS : public ExperimentSGBase
+class ExperimentSGLS : public ExperimentSGLeastSquaresBase
 {
 public:
 
-    void solveForRadiance(const std::vector<RadianceSample>& radianceSamples) override
+    void solveForRadiance(const RadianceSampleArray& radianceSamples) override
     {
         m_lobes = sgFitLeastSquares(m_lobes, radianceSamples);
     }
+
+protected:
+
+    SgBasis solveNormalEquations(const SgNormalEquations& equations) override
+    {
+        return sgSolveNormalEquations(m_lobes, equations);
+    }
 };
 
-class ExperimentSGNNLS : public ExperimentSGBase
+class ExperimentSGNNLS : public ExperimentSGLeastSquaresBase
 {
 public:
 
-    void solveForRadiance(const std::vector<RadianceSample>& radianceSamples) override
+    void solveForRadiance(const RadianceSampleArray& radianceSamples) override
+    {
+        m_lobes = sgFitNNLeastSquares(m_lobes, radianceSamples, &m_activeSet);
+    }
+
+protected:
+
+    SgBasis solveNormalEquations(const SgNormalEquations& equations) override
     {
-        m_lobes = sgFitNNLeastSquares(m_lobes, radianceSamples);
+        return sgSolveNormalEquationsNonNegative(m_lobes, equations, &m_activeSet);
     }
+
+    // Kept between runs to warm start the solve for the next probe
+    NnlsActiveSet m_activeSet;
 };
 
 class ExperimentSGGA : public ExperimentSGBase
 {
 public:
 
-    u32 m_populationCount = 50;
-    u32 m_generationCount = 2000;
+    SgGeneticAlgorithmSettings m_settings;
+
+    ExperimentSGGA& setIslandCountAndPopulation(u32 islandCount, u32 islandPopulationCount)
+    {
+        m_settings.islandCount = islandCount;
+        m_settings.islandPopulationCount = islandPopulationCount;
+        return *this;
+    }
 
-    ExperimentSGBase& setPopulationAndGenerationCount(u32 populationCount, u32 generationCount)
+    ExperimentSGGA& setGenerationCount(u32 generationCount, u32 stallGenerationCount)
     {
-        m_populationCount = populationCount;
-        m_generationCount = generationCount;
+        m_settings.generationCount = generationCount;
+        m_settings.stallGenerationCount = stallGenerationCount;
         return *this;
     }
 
-    void solveForRadiance(const std::vector<RadianceSample>& radianceSamples) override
+    void solveForRadiance(const RadianceSampleArray& radianceSamples) override
     {
         m_lobes = sgFitNNLeastSquares(m_lobes, radianceSamples); // NNLS is used to seed GA
-        m_lobes = sgFitGeneticAlgorithm(m_lobes, radianceSamples, m_populationCount, m_generationCount);
+
+        SgGeneticAlgorithmSettings settings = m_settings;
+        settings.seed = getRandomSeed();
+        m_lobes = sgFitGeneticAlgorithm(m_lobes, radianceSamples, settings);
+    }
+
+	void getProperties(std::vector<Property>& outProperties) override
+	{
+		ExperimentSGBase::getProperties(outProperties);
+		outProperties.push_back(Property("Island count", reinterpret_cast<int*>(&m_settings.islandCount)));
+		outProperties.push_back(Property("Island population count", reinterpret_cast<int*>(&m_settings.islandPopulationCount)));
+		outProperties.push_back(Property("Generation count", reinterpret_cast<int*>(&m_settings.generationCount)));
+		outProperties.push_back(Property("Stall generation count", reinterpret_cast<int*>(&m_settings.stallGenerationCount)));
+		outProperties.push_back(Property("Migration interval", reinterpret_cast<int*>(&m_settings.migrationInterval)));
+	}
+};
+
+class ExperimentSGLBFGS : public ExperimentSGBase
+{
+public:
+
+    u32 m_iterationCount = 200;
+
+    ExperimentSGLBFGS& setIterationCount(u32 iterationCount)
+    {
+        m_iterationCount = iterationCount;
+        return *this;
+    }
+
+    void solveForRadiance(const RadianceSampleArray& radianceSamples) override
+    {
+        m_lobes = sgFitLeastSquares(m_lobes, radianceSamples); // least squares amplitudes are used as the starting point
+        m_lobes = sgFitLBFGS(m_lobes, radianceSamples, m_iterationCount);
     }
 
 	void getProperties(std::vector<Property>& outProperties) override
 	{
 		ExperimentSGBase::getProperties(outProperties);
-		outProperties.push_back(Property("Population count", reinterpret_cast<int*>(&m_populationCount)));
-		outProperties.push_back(Property("Generation count", reinterpret_cast<int*>(&m_generationCount)));
+		outProperties.push_back(Property("Iteration count", reinterpret_cast<int*>(&m_iterationCount)));
 	}
 };
 
-}
\ No newline at end of file
+}
@@ -9,15 +9,9 @@ template <size_t L> class ExperimentSH : public Experiment
 public:
 	void run(SharedData& data) override
 	{
-		SphericalHarmonicsT<vec3, L> shRadiance = {};
+		typedef SphericalHarmonicsT<vec3, L> ShRGB;
 
-		const ivec2 imageSize = data.m_outputSize;
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			float texelArea = latLongTexelArea(pixelPos, imageSize);
-			vec3 radiance = (vec3)data.m_radianceImage.at(pixelPos);
-			shAddWeighted(shRadiance, shEvaluate<L>(direction), radiance * texelArea);
-		});
+		ShRGB shRadiance = data.projectSh<L>(data.m_radianceImage);
 
 		if (m_targetLaplacian > 0.0f)
 		{
@@ -30,19 +24,14 @@ public:
 			shApplyWindowing<vec3, L>(shRadiance, m_lambda);
 		}
 
-		m_radianceImage = Image(data.m_outputSize);
-		m_irradianceImage = Image(data.m_outputSize);
-
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+		ShRGB shIrradiance = shConvolveDiffuse(shRadiance);
+		for (size_t i = 0; i < shSize(L); ++i)
 		{
-			SphericalHarmonicsT<float, L> shDirection = shEvaluate<L>(direction);
-
-			vec3 sampleSh = max(vec3(0.0f), shDot(shRadiance, shDirection));
-			m_radianceImage.at(pixelPos) = vec4(sampleSh, 1.0f);
+			shIrradiance[i] /= pi;
+		}
 
-			vec3 sampleIrradianceSh = max(vec3(0.0f), shEvaluateDiffuse<vec3, L>(shRadiance, direction) / pi);
-			m_irradianceImage.at(pixelPos) = vec4(sampleIrradianceSh, 1.0f);
-		});
+		m_radianceImage = data.reconstructSh(shRadiance);
+		m_irradianceImage = data.reconstructSh(shIrradiance);
 	}
 
 	void getProperties(std::vector<Property>& outProperties) override
@@ -73,37 +62,30 @@ class ExperimentSHL1Geomerics : public Experiment
 public:
 	void run(SharedData& data) override
 	{
-		SphericalHarmonicsL1RGB shRadiance = {};
-
-		const ivec2 imageSize = data.m_outputSize;
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			float texelArea = latLongTexelArea(pixelPos, imageSize);
-			vec3 radiance = (vec3)data.m_radianceImage.at(pixelPos);
-			shAddWeighted(shRadiance, shEvaluateL1(direction), radiance * texelArea);
-		});
+		SphericalHarmonicsL1RGB shRadiance = data.projectSh<1>(data.m_radianceImage);
 
-		m_radianceImage = Image(data.m_outputSize);
+		m_radianceImage = data.reconstructSh(shRadiance);
 		m_irradianceImage = Image(data.m_outputSize);
 
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+		const u32 width = data.m_outputSize.x;
+		parallelForRange(0u, (u32)data.m_outputSize.y, 1, [&](const ParallelRange& range)
 		{
-			SphericalHarmonicsL1 directionSh = shEvaluateL1(direction);
-
-			vec3 sampleSh = max(vec3(0.0f), shDot(shRadiance, directionSh));
-			m_radianceImage.at(pixelPos) = vec4(sampleSh, 1.0f);
-
-			vec3 sampleIrradianceSh;
-			for (u32 i = 0; i < 3; ++i)
+			for (u32 texelIndex = range.begin * width; texelIndex != range.end * width; ++texelIndex)
 			{
-				SphericalHarmonicsL1 shRadianceChannel;
-				shRadianceChannel[0] = shRadiance[0][i];
-				shRadianceChannel[1] = shRadiance[1][i];
-				shRadianceChannel[2] = shRadiance[2][i];
-				shRadianceChannel[3] = shRadiance[3][i];
-				sampleIrradianceSh[i] = shEvaluateDiffuseL1Geomerics(shRadianceChannel, direction) / pi;
+				const vec3 direction = data.m_directions.get(texelIndex);
+
+				vec3 sampleIrradianceSh;
+				for (u32 i = 0; i < 3; ++i)
+				{
+					SphericalHarmonicsL1 shRadianceChannel;
+					shRadianceChannel[0] = shRadiance[0][i];
+					shRadianceChannel[1] = shRadiance[1][i];
+					shRadianceChannel[2] = shRadiance[2][i];
+					shRadianceChannel[3] = shRadiance[3][i];
+					sampleIrradianceSh[i] = shEvaluateDiffuseL1Geomerics(shRadianceChannel, direction) / pi;
+				}
+				m_irradianceImage.at(texelIndex) = vec4(sampleIrradianceSh, 1.0f);
 			}
-			m_irradianceImage.at(pixelPos) = vec4(sampleIrradianceSh, 1.0f);
 		});
 	}
 };
@@ -18,18 +18,7 @@ public:
 	void run(SharedData& data) override
 	{
 		// Compute the input SH.
-		SphericalHarmonicsL2RGB shRadiance = {};
-
-		const ivec2 imageSize = data.m_outputSize;
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			float texelArea = latLongTexelArea(pixelPos, imageSize);
-			vec3 radiance = (vec3)data.m_radianceImage.at(pixelPos);
-			shAddWeighted(shRadiance, shEvaluateL2(direction), radiance * texelArea);
-		});
-
-		m_radianceImage = Image(data.m_outputSize);
-		m_irradianceImage = Image(data.m_outputSize);
+		SphericalHarmonicsL2RGB shRadiance = data.projectSh<2>(data.m_radianceImage);
 
 		const float irradianceBandScales[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
 
@@ -65,16 +54,8 @@ public:
 			shRadiance[i] = shIrradiance[i] * (1.0f / irradianceBandScales[i]);
 		}
 
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			SphericalHarmonicsL2 directionSh = shEvaluateL2(direction);
-
-			vec3 sampleSh = max(vec3(0.0f), shDot(shRadiance, directionSh));
-			m_radianceImage.at(pixelPos) = vec4(sampleSh, 1.0f);
-
-			vec3 sampleIrradianceSh = max(vec3(0.0f), shDot(shIrradiance, directionSh));
-			m_irradianceImage.at(pixelPos) = vec4(sampleIrradianceSh, 1.0f);
-		});
+		m_radianceImage = data.reconstructSh(shRadiance);
+		m_irradianceImage = data.reconstructSh(shIrradiance);
 	}
 
 	void getProperties(std::vector<Property>& outProperties) override
@@ -99,28 +80,21 @@ class ExperimentHallucinateZH3: public Experiment
 public:
 	void run(SharedData& data) override
 	{
-		SphericalHarmonicsL1RGB shRadiance = {};
-
-		const ivec2 imageSize = data.m_outputSize;
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			float texelArea = latLongTexelArea(pixelPos, imageSize);
-			vec3 radiance = (vec3)data.m_radianceImage.at(pixelPos);
-			shAddWeighted(shRadiance, shEvaluateL1(direction), radiance * texelArea);
-		});
+		SphericalHarmonicsL1RGB shRadiance = data.projectSh<1>(data.m_radianceImage);
 
-		m_radianceImage = Image(data.m_outputSize);
+		m_radianceImage = data.reconstructSh(shRadiance);
 		m_irradianceImage = Image(data.m_outputSize);
 
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
+		const u32 width = data.m_outputSize.x;
+		parallelForRange(0u, (u32)data.m_outputSize.y, 1, [&](const ParallelRange& range)
 		{
-			SphericalHarmonicsL1 directionSh = shEvaluateL1(direction);
-
-			vec3 sampleSh = max(vec3(0.0f), shDot(shRadiance, directionSh));
-			m_radianceImage.at(pixelPos) = vec4(sampleSh, 1.0f);
+			for (u32 texelIndex = range.begin * width; texelIndex != range.end * width; ++texelIndex)
+			{
+				const vec3 direction = data.m_directions.get(texelIndex);
 
-			vec3 sampleIrradianceSh = max(vec3(0.0f), shEvaluateDiffuseL1ZH3Hallucinate(shRadiance, direction) / pi);
-			m_irradianceImage.at(pixelPos) = vec4(sampleIrradianceSh, 1.0f);
+				vec3 sampleIrradianceSh = max(vec3(0.0f), shEvaluateDiffuseL1ZH3Hallucinate(shRadiance, direction) / pi);
+				m_irradianceImage.at(texelIndex) = vec4(sampleIrradianceSh, 1.0f);
+			}
 		});
 	}
 };
@@ -132,18 +106,7 @@ class ExperimentSolveHallucinateZH3: public Experiment
 public:
 	void run(SharedData& data) override
 	{
-		SphericalHarmonicsL2RGB shRadiance = {};
-
-		const ivec2 imageSize = data.m_outputSize;
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			float texelArea = latLongTexelArea(pixelPos, imageSize);
-			vec3 radiance = (vec3)data.m_radianceImage.at(pixelPos);
-			shAddWeighted(shRadiance, shEvaluateL2(direction), radiance * texelArea);
-		});
-
-		m_radianceImage = Image(data.m_outputSize);
-		m_irradianceImage = Image(data.m_outputSize);
+		SphericalHarmonicsL2RGB shRadiance = data.projectSh<2>(data.m_radianceImage);
 
 		const float irradianceBandScales[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
 
@@ -182,16 +145,8 @@ public:
 			shRadiance[i] = shIrradiance[i] * (1.0f / irradianceBandScales[i]);
 		}
 
-		data.m_directionImage.forPixels2D([&](const vec3& direction, ivec2 pixelPos)
-		{
-			SphericalHarmonicsL2 directionSh = shEvaluateL2(direction);
-
-			vec3 sampleSh = max(vec3(0.0f), shDot(shRadiance, directionSh));
-			m_radianceImage.at(pixelPos) = vec4(sampleSh, 1.0f);
-
-			vec3 sampleIrradianceSh = max(vec3(0.0f), shDot(shIrradiance, directionSh));
-			m_irradianceImage.at(pixelPos) = vec4(sampleIrradianceSh, 1.0f);
-		});
+		m_radianceImage = data.reconstructSh(shRadiance);
+		m_irradianceImage = data.reconstructSh(shIrradiance);
 	}
 
 	void getProperties(std::vector<Property>& outProperties) override
@@ -1,12 +1,17 @@
 #include <Probulator/Experiments.h>
 
 #include <Probulator/ExperimentMonteCarlo.h>
+#include <Probulator/ExperimentExactConvolution.h>
 #include <Probulator/ExperimentSH.h>
 #include <Probulator/ExperimentSG.h>
 #include <Probulator/ExperimentHBasis.h>
 #include <Probulator/ExperimentAmbientCube.h>
 #include <Probulator/ExperimentAmbientDice.h>
 #include <Probulator/ExperimentZH3.h>
+#include <Probulator/Thread.h>
+
+#include <atomic>
+#include <unordered_map>
 
 namespace Probulator
 {
@@ -21,32 +26,153 @@ inline T& addExperiment(ExperimentList& list, const char* name, const char* suff
     return *e;
 }
 
+const Eigen::MatrixXf& Experiment::SharedData::getBasisMatrix(BasisType type, u32 order) const
+{
+	// The matrix is built serially while holding the lock. Waiting for a parallel loop here could run
+	// tasks of other experiments on this thread, which may request a basis matrix themselves.
+	std::lock_guard<std::mutex> lock(m_basisMatricesMutex);
+
+	std::unique_ptr<Eigen::MatrixXf>& matrix = m_basisMatrices[std::make_pair(type, order)];
+	if (matrix)
+	{
+		return *matrix;
+	}
+
+	PROBULATOR_TRACE_SCOPE("SharedData::getBasisMatrix");
+	PROBULATOR_MEMORY_SCOPE(MemoryPhase_Projection);
+
+	const u32 texelCount = (u32)m_directions.size();
+
+	switch (type)
+	{
+	case BasisType_SH:
+		matrix.reset(new Eigen::MatrixXf(texelCount, shSize(order)));
+		shEvaluateBatch(order, m_directions.x.data(), m_directions.y.data(), m_directions.z.data(),
+			texelCount, matrix->data(), texelCount);
+		break;
+	case BasisType_H:
+		matrix.reset(new Eigen::MatrixXf(texelCount, hSize(order)));
+		for (u32 texelIt = 0; texelIt < texelCount; ++texelIt)
+		{
+			const vec3 direction = m_directions.get(texelIt);
+			if (order == 4)
+			{
+				HBasis4 h = hEvaluate4(direction);
+				for (u32 i = 0; i < 4; ++i) (*matrix)(texelIt, i) = h[i];
+			}
+			else if (order == 6)
+			{
+				HBasis6 h = hEvaluate6(direction);
+				for (u32 i = 0; i < 6; ++i) (*matrix)(texelIt, i) = h[i];
+			}
+			else
+			{
+				assert(!"HBasis only supports 4 and 6 basis functions");
+			}
+		}
+		break;
+	}
+
+	return *matrix;
+}
+
+// Lat-long rows per block of the parallel projection and reconstruction products.
+// Fixed so that projection results do not depend on the thread count.
+static const u32 BasisProductBlockRows = 8;
+
+Eigen::MatrixXf Experiment::SharedData::projectImage(BasisType type, u32 order, const Image& image) const
+{
+	PROBULATOR_TRACE_SCOPE("SharedData::projectImage");
+	PROBULATOR_MEMORY_SCOPE(MemoryPhase_Projection);
+
+	const Eigen::MatrixXf& basis = getBasisMatrix(type, order);
+
+	const u32 width = m_outputSize.x;
+	const u32 height = m_outputSize.y;
+	const u32 blockCount = (height + BasisProductBlockRows - 1) / BasisProductBlockRows;
+
+	return parallelReduce(0u, blockCount, 1, Eigen::MatrixXf(Eigen::MatrixXf::Zero(basis.cols(), 3)),
+		[&](Eigen::MatrixXf& accumulator, u32 blockIt)
+	{
+		const u32 rowBegin = blockIt * BasisProductBlockRows;
+		const u32 rowEnd = std::min(rowBegin + BasisProductBlockRows, height);
+		const u32 texelBegin = rowBegin * width;
+		const u32 texelCount = (rowEnd - rowBegin) * width;
+
+		Eigen::MatrixXf weightedTexels(texelCount, 3);
+		PROBULATOR_MEMORY_CHARGE(memoryGetMatrixBytes(weightedTexels));
+		for (u32 i = 0; i < texelCount; ++i)
+		{
+			vec3 value = (vec3)image.at(texelBegin + i) * getTexelArea(texelBegin + i);
+			weightedTexels.row(i) << value.x, value.y, value.z;
+		}
+
+		accumulator.noalias() += basis.middleRows(texelBegin, texelCount).transpose() * weightedTexels;
+	},
+		[](const Eigen::MatrixXf& a, const Eigen::MatrixXf& b) -> Eigen::MatrixXf { return a + b; });
+}
+
+Image Experiment::SharedData::reconstructImage(BasisType type, u32 order, const Eigen::MatrixXf& coefficients) const
+{
+	PROBULATOR_TRACE_SCOPE("SharedData::reconstructImage");
+	PROBULATOR_MEMORY_SCOPE(MemoryPhase_Reconstruction);
+
+	const Eigen::MatrixXf& basis = getBasisMatrix(type, order);
+
+	const u32 width = m_outputSize.x;
+	const u32 height = m_outputSize.y;
+
+	Image result(m_outputSize);
+	parallelForRange(0u, height, BasisProductBlockRows, [&](const ParallelRange& range)
+	{
+		const u32 texelBegin = range.begin * width;
+		const u32 texelCount = (range.end - range.begin) * width;
+
+		Eigen::MatrixXf texels = basis.middleRows(texelBegin, texelCount) * coefficients;
+		PROBULATOR_MEMORY_CHARGE(memoryGetMatrixBytes(texels));
+
+		for (u32 i = 0; i < texelCount; ++i)
+		{
+			result.at(texelBegin + i) = vec4(max(vec3(0.0f), vec3(texels(i, 0), texels(i, 1), texels(i, 2))), 1.0f);
+		}
+	});
+	return result;
+}
+
 void addAllExperiments(ExperimentList& experiments)
 {
     const u32 lobeCount = 12; // <-- tweak this
     const float lambda = 0.5f * lobeCount; // <-- tweak this; 
 
-    Experiment* experimentMCIS = &addExperiment<ExperimentMCIS>(experiments, "Monte Carlo [Importance Sampling]", "MCIS")
-        .setSampleCount(5000)
-        .setJitterEnabled(false) // prefer errors due to correlation instead of noise due to jittering
+    Experiment* experimentReference = &addExperiment<ExperimentExactConvolution>(experiments, "Exact Convolution", "EXACT")
         .setUseAsReference(true); // other experiments will be compared against this
 
+    addExperiment<ExperimentMCIS>(experiments, "Monte Carlo [Importance Sampling]", "MCIS")
+        .setSampleCount(5000)
+        .setJitterEnabled(false); // prefer errors due to correlation instead of noise due to jittering
+
     addExperiment<ExperimentMCIS>(experiments, "Monte Carlo [Importance Sampling, Jittered]", "MCISS")
         .setSampleCount(5000)
         .setJitterEnabled(true)
         .setEnabled(false); // disabled by default, since MCIS mode is superior
 
+    addExperiment<ExperimentMCIS>(experiments, "Monte Carlo [Importance Sampling, Adaptive]", "MCISA")
+        .setSampleCount(20000)
+        .setJitterEnabled(true)
+        .setAdaptiveSampling(true, 0.01f)
+        .setEnabled(false); // disabled by default, useful to produce references with a known error bound
+
     addExperiment<ExperimentMC>(experiments, "Monte Carlo", "MC")
         .setHemisphereSampleCount(5000)
         .setEnabled(false); // disabled by default, since MCIS mode is superior
 
 	addExperiment<ExperimentAmbientCube>(experiments, "Ambient Cube [Non-Negative Least Squares]", "AC")
 		.setProjectionEnabled(false)
-		.setInput(experimentMCIS);
+		.setInput(experimentReference);
 
 	addExperiment<ExperimentAmbientCube>(experiments, "Ambient Cube [Projection]", "ACPROJ")
 		.setProjectionEnabled(true)
-		.setInput(experimentMCIS);
+		.setInput(experimentReference);
 
     addExperiment<ExperimentSHL1Geomerics>(experiments, "Spherical Harmonics L1 [Geomerics]", "SHL1G");
 
@@ -63,24 +189,24 @@ void addAllExperiments(ExperimentList& experiments)
 		.setTargetLaplacian(10.0f); // Empirically chosen
 
     addExperiment<ExperimentHBasis<4>>(experiments, "HBasis-4", "H4")
-        .setInput(experimentMCIS)
+        .setInput(experimentReference)
 		.setEnabled(false);
 
     addExperiment<ExperimentHBasis<6>>(experiments, "HBasis-6", "H6")
-        .setInput(experimentMCIS)
+        .setInput(experimentReference)
 		.setEnabled(false);
     
     addExperiment<ExperimentAmbientDice>(experiments, "Ambient Dice [Bezier]", "AD")
     .setDiceType(AmbientDiceTypeBezier)
-    .setInput(experimentMCIS);
+    .setInput(experimentReference);
     
     addExperiment<ExperimentAmbientDice>(experiments, "Ambient Dice [Bezier Y/Co/Cg]", "ADYCoCg")
     .setDiceType(AmbientDiceTypeBezierYCoCg)
-    .setInput(experimentMCIS);
+    .setInput(experimentReference);
     
     addExperiment<ExperimentAmbientDice>(experiments, "Ambient Dice [Cosine SRBF]", "ADRBF")
     .setDiceType(AmbientDiceTypeSRBF)
-    .setInput(experimentMCIS);
+    .setInput(experimentReference);
 
     addExperiment<ExperimentSGNaive>(experiments, "Spherical Gaussians [Naive]", "SG")
         .setBrdfLambda(8.5f) // Chosen arbitrarily through experimentation
@@ -98,6 +224,12 @@ void addAllExperiments(ExperimentList& experiments)
     addExperiment<ExperimentSGNNLS>(experiments, "Spherical Gaussians [Non-Negative Least Squares]", "SGNNLS")
         .setBrdfLambda(3.0f) // Chosen arbitrarily through experimentation
         .setLobeCountAndLambda(lobeCount, lambda);
+
+    addExperiment<ExperimentSGLS>(experiments, "Spherical Gaussians [Least Squares, Streaming]", "SGLSS")
+        .setStreamingSampleCount(1 << 20)
+        .setBrdfLambda(3.0f) // Chosen arbitrarily through experimentation
+        .setLobeCountAndLambda(lobeCount, lambda)
+        .setEnabled(false); // disabled by default, as it takes longer to generate samples than to fit them
     
     addExperiment<ExperimentSGRunningAverage>(experiments, "Spherical Gaussians [Running Average]", "SGRA")
         .setLobeCountAndLambda(lobeCount, lambda);
@@ -106,11 +238,17 @@ void addAllExperiments(ExperimentList& experiments)
         .setLobeCountAndLambda(lobeCount, lambda)
         .setNonNegativeSolve(true);
 
+    addExperiment<ExperimentSGLBFGS>(experiments, "Spherical Gaussians [L-BFGS]", "SGLBFGS")
+        .setIterationCount(200)
+        .setBrdfLambda(3.0f) // Chosen arbitrarily through experimentation
+        .setLobeCountAndLambda(lobeCount, lambda);
+
     addExperiment<ExperimentSGGA>(experiments, "Spherical Gaussians [Genetic Algorithm]", "SGGA")
-        .setPopulationAndGenerationCount(50, 2000)
+        .setIslandCountAndPopulation(4, 16)
+        .setGenerationCount(2000, 100)
         .setBrdfLambda(3.0f) // Chosen arbitrarily through experimentation
         .setLobeCountAndLambda(lobeCount, lambda)
-        .setEnabled(false); // disabled by default, as it requires *very* long time to converge
+        .setEnabled(false); // disabled by default, as it still takes much longer than other fits to converge
 }
 
 void resetAllExperiments(ExperimentList& experiments)
@@ -121,4 +259,123 @@ void resetAllExperiments(ExperimentList& experiments)
 	}
 }
 
+// Node of the experiment dependency graph.
+// Dependents are scheduled by whichever task finishes their last dependency, and that task waits for them,
+// so a task only completes after everything it scheduled. Waiting runs other tasks in the meantime.
+struct ExperimentTask : enki::ITaskSet
+{
+	void ExecuteRange(enki::TaskSetPartition, u32) override
+	{
+		m_experiment->execute(*m_data);
+
+		std::vector<ExperimentTask*> scheduled;
+		for (ExperimentTask* dependent : m_dependents)
+		{
+			if (dependent->m_pendingDependencyCount.fetch_sub(1) == 1)
+			{
+				g_TS.AddTaskSetToPipe(dependent);
+				scheduled.push_back(dependent);
+			}
+		}
+
+		for (ExperimentTask* dependent : scheduled)
+		{
+			g_TS.WaitforTask(dependent);
+		}
+	}
+
+	Experiment* m_experiment = nullptr;
+	Experiment::SharedData* m_data = nullptr;
+	std::vector<ExperimentTask*> m_dependents;
+	std::atomic<u32> m_pendingDependencyCount;
+};
+
+// Completes when all experiments are done: every experiment is either a root or scheduled (and waited for)
+// by one of its dependencies, see ExperimentTask
+struct ExperimentGraphTask : enki::ITaskSet
+{
+	void ExecuteRange(enki::TaskSetPartition, u32) override
+	{
+		for (ExperimentTask* root : m_roots)
+		{
+			g_TS.AddTaskSetToPipe(root);
+		}
+
+		for (ExperimentTask* root : m_roots)
+		{
+			g_TS.WaitforTask(root);
+		}
+	}
+
+	std::vector<ExperimentTask*> m_roots;
+};
+
+void runAllExperiments(ExperimentList& experiments, Experiment::SharedData& data)
+{
+	PROBULATOR_TRACE_SCOPE("runAllExperiments");
+
+	std::vector<std::unique_ptr<ExperimentTask>> tasks;
+	std::unordered_map<Experiment*, ExperimentTask*> taskMap;
+
+	// Gather enabled experiments and all of their dependencies that still need to run
+
+	std::vector<Experiment*> stack;
+	for (const auto& e : experiments)
+	{
+		if (e->m_enabled)
+		{
+			stack.push_back(e.get());
+		}
+	}
+
+	while (!stack.empty())
+	{
+		Experiment* e = stack.back();
+		stack.pop_back();
+
+		if (e->m_executed || taskMap.count(e))
+			continue;
+
+		ExperimentTask* task = new ExperimentTask;
+		task->m_experiment = e;
+		task->m_data = &data;
+		task->m_pendingDependencyCount = 0;
+		tasks.push_back(std::unique_ptr<ExperimentTask>(task));
+		taskMap[e] = task;
+
+		for (Experiment* d : e->m_dependencies)
+		{
+			stack.push_back(d);
+		}
+	}
+
+	for (const auto& task : tasks)
+	{
+		for (Experiment* d : task->m_experiment->m_dependencies)
+		{
+			auto it = taskMap.find(d);
+			if (it != taskMap.end())
+			{
+				it->second->m_dependents.push_back(task.get());
+				task->m_pendingDependencyCount++;
+			}
+		}
+	}
+
+	ExperimentGraphTask graphTask;
+	for (const auto& task : tasks)
+	{
+		if (task->m_pendingDependencyCount == 0)
+		{
+			graphTask.m_roots.push_back(task.get());
+		}
+	}
+
+	taskSchedulerEnsureInitialized();
+
+	// The main thread runs experiments while it waits
+	g_TS.AddTaskSetToPipe(&graphTask);
+	g_TS.WaitforTask(&graphTask);
+}
+
 } // namespace Probulator
@@ -2,6 +2,7 @@
 
 #include <Probulator/Common.h>
 #include <Probulator/Math.h>
+#include <Probulator/Memory.h>
 #include <Probulator/Image.h>
 #include <Probulator/SphericalGaussian.h>
 #include <Probulator/SGBasis.h>
@@ -9,10 +10,19 @@
 #include <Probulator/SphericalHarmonics.h>
 #include <Probulator/Variance.h>
 #include <Probulator/RadianceSample.h>
+#include <Probulator/RunningAverage.h>
 #include <Probulator/SGFitGeneticAlgorithm.h>
+#include <Probulator/SGFitLBFGS.h>
 #include <Probulator/SGFitLeastSquares.h>
+#include <Probulator/Trace.h>
 #include <Probulator/DiscreteDistribution.h>
-#include <Probulator/DiscreteDistribution.h>
+#include <Probulator/Vec3Array.h>
+
+#include <Eigen/Core>
+
+#include <map>
+#include <memory>
+#include <mutex>
 
 namespace Probulator
 {
@@ -31,6 +41,12 @@ public:
 		PropertyType_Vec4,
 	};
 
+	enum BasisType
+	{
+		BasisType_SH, // order is L
+		BasisType_H, // order is the number of basis functions
+	};
+
 	struct Property
 	{
 		Property(const char* name, bool* data) : m_name(name), m_type(PropertyType_Bool) { m_data.asBool = data; }
@@ -57,17 +73,12 @@ public:
     {
     private:
 
-        void generateSamples(u32 sampleCount, Image& image, std::vector<RadianceSample>& samples)
+        void generateSamples(u32 sampleCount, Image& image, RadianceSampleArray& samples)
         {
-            samples.reserve(sampleCount);
+            samples.resize(sampleCount);
             for (u32 sampleIt = 0; sampleIt < sampleCount; ++sampleIt)
             {
-                vec2 sampleUv = vec2(sampleHalton(sampleIt + 1, 2), sampleHalton(sampleIt + 1, 3));
-                vec3 direction = m_basis * sampleUniformSphere(sampleUv);
-
-                vec3 sample = (vec3)image.sampleNearest(cartesianToLatLongTexcoord(direction));
-
-                samples.push_back({ direction, sample });
+                samples.set(sampleIt, generateSample(sampleIt, image));
             }
         }
 
@@ -98,44 +109,154 @@ public:
 
 		void initialize()
 		{
+			PROBULATOR_TRACE_SCOPE("SharedData::initialize");
+
 			if (m_radianceImage.getSize() != m_outputSize)
 			{
-				m_radianceImage = imageResize(m_radianceImage, m_outputSize);
+				m_sourceRadianceImage = std::move(m_radianceImage);
+				m_radianceImage = imageResize(m_sourceRadianceImage, m_outputSize);
+			}
+			else
+			{
+				m_sourceRadianceImage = m_radianceImage;
 			}
 
+			m_directions.resize(m_directionImage.getPixelCount());
 			m_directionImage.forPixels2D([&](vec3& direction, ivec2 pixelPos)
 			{
 				vec2 uv = (vec2(pixelPos) + vec2(0.5f)) / vec2(m_outputSize);
 				direction = latLongTexcoordToCartesian(uv);
+				m_directions.set(pixelPos.x + pixelPos.y * m_outputSize.x, direction);
 			});
 
+			// Texel solid angle only depends on latitude
+			m_texelAreaByRow.resize(m_outputSize.y);
+			for (int y = 0; y < m_outputSize.y; ++y)
+			{
+				m_texelAreaByRow[y] = latLongTexelArea(ivec2(0, y), m_outputSize);
+			}
+
 			generateSamples(m_sampleCount, m_radianceImage, m_radianceSamples);
 		}
 
+        // Sample of an image in the sampleIt-th direction of the uniform sphere sequence used for m_radianceSamples.
+        // Allows experiments to use more samples than m_radianceSamples holds without storing them.
+        RadianceSample generateSample(u32 sampleIt, const Image& image) const
+        {
+            vec2 sampleUv = vec2(sampleHalton(sampleIt + 1, 2), sampleHalton(sampleIt + 1, 3));
+            vec3 direction = m_basis * sampleUniformSphere(sampleUv);
+
+            vec3 sample = (vec3)image.sampleNearest(cartesianToLatLongTexcoord(direction));
+
+            return { direction, sample };
+        }
+
         bool isValid() const
         {
             return m_radianceImage.getSizeBytes() != 0;
         }
 
+        // Deterministic parallel reduction over all lat-long texels (see parallelReduce).
+        // Invoke fun(T& accumulator, const vec3& direction, float texelArea, u32 texelIndex) row by row,
+        // reading directions and solid angles from the precomputed tables.
+        template <typename T, typename F, typename C>
+        T parallelReduceTexels(const T& identity, F fun, C combine) const
+        {
+            const u32 width = m_outputSize.x;
+            return parallelReduce(0u, (u32)m_outputSize.y, 1, identity, [&](T& accumulator, u32 y)
+            {
+                const u32 rowBegin = y * width;
+                const float texelArea = m_texelAreaByRow[y];
+                const float* directionX = &m_directions.x[rowBegin];
+                const float* directionY = &m_directions.y[rowBegin];
+                const float* directionZ = &m_directions.z[rowBegin];
+                for (u32 x = 0; x < width; ++x)
+                {
+                    fun(accumulator, vec3(directionX[x], directionY[x], directionZ[x]), texelArea, rowBegin + x);
+                }
+            }, combine);
+        }
+
+        // Basis functions evaluated at all lat-long texel directions, one row per texel (x + y * width)
+        // and one column per basis function. Built on first use and shared by all experiments.
+        const Eigen::MatrixXf& getBasisMatrix(BasisType type, u32 order) const;
+
+        // Projects an image with texels matching m_directionImage onto basis functions with a single matrix product.
+        // Returns one row per basis function and one column per color channel.
+        Eigen::MatrixXf projectImage(BasisType type, u32 order, const Image& image) const;
+
+        // Evaluates a function given by basis coefficients (one row per basis function, one column per color channel)
+        // at all texel directions with a single matrix product. Negative values are clamped to zero.
+        Image reconstructImage(BasisType type, u32 order, const Eigen::MatrixXf& coefficients) const;
+
+        template <size_t L>
+        SphericalHarmonicsT<vec3, L> projectSh(const Image& image) const
+        {
+            Eigen::MatrixXf coefficients = projectImage(BasisType_SH, L, image);
+
+            SphericalHarmonicsT<vec3, L> result;
+            for (size_t i = 0; i < shSize(L); ++i)
+            {
+                result[i] = vec3(coefficients(i, 0), coefficients(i, 1), coefficients(i, 2));
+            }
+            return result;
+        }
+
+        template <size_t L>
+        Image reconstructSh(const SphericalHarmonicsT<vec3, L>& sh) const
+        {
+            Eigen::MatrixXf coefficients(shSize(L), 3);
+            for (size_t i = 0; i < shSize(L); ++i)
+            {
+                coefficients.row(i) << sh[i].x, sh[i].y, sh[i].z;
+            }
+            return reconstructImage(BasisType_SH, L, coefficients);
+        }
+
+        float getTexelArea(u32 texelIndex) const
+        {
+            return m_texelAreaByRow[texelIndex / m_outputSize.x];
+        }
+
+        // Only called by the experiment marked as reference. Readers of m_irradianceSamples must
+        // depend on it (see Experiment::setInput), so the task graph orders the write before the reads.
         void GenerateIrradianceSamples(Image& irradianceimage)
         {
-            generateSamples(m_sampleCount, irradianceimage, m_irradianceSamples);
+            PROBULATOR_TRACE_SCOPE("SharedData::GenerateIrradianceSamples");
+
+            RadianceSampleArray samples;
+            generateSamples(m_sampleCount, irradianceimage, samples);
+            m_irradianceSamples.swap(samples);
         }
 
         // directions corresponding to lat-long texels
         ImageBase<vec3> m_directionImage;
 
+        // m_directionImage in structure-of-arrays layout, indexed by x + y * width
+        Vec3Array m_directions;
+
+        // solid angle of a lat-long texel in each row
+        std::vector<float> m_texelAreaByRow;
+
         // lat-long radiance 
         Image m_radianceImage;
 
+        // lat-long radiance at the original resolution of the input, before resizing to m_outputSize
+        Image m_sourceRadianceImage;
+
         // radiance samples uniformly distributed over a sphere
-        std::vector<RadianceSample> m_radianceSamples;
-        std::vector<RadianceSample> m_irradianceSamples;
+        RadianceSampleArray m_radianceSamples;
+        RadianceSampleArray m_irradianceSamples;
 
         ivec2 m_outputSize;
         u32 m_sampleCount;
 
 		mat3 m_basis = mat3(1.0f);
+
+    private:
+
+        mutable std::mutex m_basisMatricesMutex;
+        mutable std::map<std::pair<BasisType, u32>, std::unique_ptr<Eigen::MatrixXf>> m_basisMatrices;
     };
 
 	virtual void getProperties(std::vector<Property>& outProperties)
@@ -157,6 +278,15 @@ public:
             d->runWithDepencencies(data);
         }
 
+        execute(data);
+    }
+
+    // Runs the experiment assuming that all dependencies have already been executed
+    void execute(SharedData& data)
+    {
+        PROBULATOR_TRACE_SCOPE(m_name);
+        PROBULATOR_MEMORY_SCOPE(m_name);
+
         run(data);
 
         // Compute max irradiance sample
@@ -204,6 +334,18 @@ public:
 		m_executed = false;
 	}
 
+    // Key for RandomStream, derived from the suffix so that every experiment has its own streams
+    // that stay the same between runs (FNV-1a hash)
+    u64 getRandomSeed() const
+    {
+        u64 hash = 14695981039346656037ull;
+        for (char c : m_suffix)
+        {
+            hash = (hash ^ u8(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
     // Experiment metadata
 
     std::string m_name;
@@ -226,4 +368,8 @@ typedef std::vector<std::unique_ptr<Experiment>> ExperimentList;
 void addAllExperiments(ExperimentList& experiments);
 void resetAllExperiments(ExperimentList& experiments);
 
+// Runs all enabled experiments and their dependencies.
+// Experiments that do not depend on each other are executed concurrently.
+void runAllExperiments(ExperimentList& experiments, Experiment::SharedData& data);
+
 } // namespace Probulator
\ No newline at end of file
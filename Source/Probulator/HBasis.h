@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Math.h"
+#include "RadianceSample.h"
 
 namespace Probulator
 {
@@ -103,12 +104,13 @@ namespace Probulator
 	}
 	
 	template <typename T, size_t L>
-	inline T hMeanSquareError(const HBasisT<T, L>& h, const std::vector<RadianceSample>& radianceSamples)
+	inline T hMeanSquareError(const HBasisT<T, L>& h, const RadianceSampleArray& radianceSamples)
 	{
 		T errorSquaredSum = T(0.0f);
 
-		for (const RadianceSample& sample : radianceSamples)
+		for (u32 sampleIt = 0; sampleIt < radianceSamples.size(); ++sampleIt)
 		{
+			const RadianceSample sample = radianceSamples[sampleIt];
 			auto directionH = hEvaluate<L>(sample.direction);
 			auto reconstructedValue = hDot(h, directionH);
 			auto error = sample.value - reconstructedValue;
@@ -120,7 +122,7 @@ namespace Probulator
 	}
 
 	template <typename T, size_t L>
-	inline float hMeanSquareErrorScalar(const HBasisT<T, L>& sh, const std::vector<RadianceSample>& radianceSamples)
+	inline float hMeanSquareErrorScalar(const HBasisT<T, L>& sh, const RadianceSampleArray& radianceSamples)
 	{
 		return dot(hMeanSquareError(sh, radianceSamples), T(1.0f / 3.0f));
 	}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "Math.h"
+
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+namespace Probulator
+{
+	// Discrete probability distribution over a 2D grid of weights, sampled by descending a pyramid of partial sums.
+	// Every level halves the resolution of the level below it until a single cell remains, so drawing a sample
+	// visits O(log n) levels. Children of every cell are stored next to each other, so each level of the descent
+	// touches one cache line. Levels are padded to power of two dimensions with zero weights, which are never selected.
+	// The pyramid holds 4/3 of the padded weight count: 4/3 of the weights for power of two sizes, but up to
+	// about 16/3 when both dimensions are just above a power of two (see getSizeBytes).
+	// Weights must be non-negative and have a non-zero sum.
+	class HierarchicalDistribution
+	{
+	public:
+
+		HierarchicalDistribution(const float* weights, ivec2 size)
+			: m_size(size)
+		{
+			// Build the levels above the weights in row-major order first.
+			// The padded bottom level is never stored in row-major order, it is read from weights directly.
+
+			std::vector<std::vector<float>> rowMajorLevels(1);
+			std::vector<ivec2> levelSizes;
+
+			auto getRowMajor = [&](size_t level, ivec2 pos) -> float
+			{
+				if (level == 0)
+				{
+					return pos.x < size.x && pos.y < size.y ? weights[pos.x + pos.y * size.x] : 0.0f;
+				}
+				return rowMajorLevels[level][pos.x + pos.y * levelSizes[level].x];
+			};
+
+			ivec2 levelSize = ivec2(nextPowerOfTwo(size.x), nextPowerOfTwo(size.y));
+			levelSizes.push_back(levelSize);
+
+			while (levelSize.x > 1 || levelSize.y > 1)
+			{
+				const size_t childLevel = levelSizes.size() - 1;
+				const ivec2 childSize = levelSize;
+				levelSize = max(levelSize / 2, ivec2(1));
+				const ivec2 scale = childSize / levelSize;
+
+				std::vector<float> parent(levelSize.x * levelSize.y);
+				for (int y = 0; y < levelSize.y; ++y)
+				{
+					for (int x = 0; x < levelSize.x; ++x)
+					{
+						float sum = 0.0f;
+						for (int i = 0; i < scale.x * scale.y; ++i)
+						{
+							sum += getRowMajor(childLevel, ivec2(x, y) * scale + getChildOffset(i, scale));
+						}
+						parent[x + y * levelSize.x] = sum;
+					}
+				}
+
+				m_levelScales.push_back(scale);
+				levelSizes.push_back(levelSize);
+				rowMajorLevels.push_back(std::move(parent));
+			}
+
+			// Reorder levels from the top, so that children of the cell at index p are stored at [p * childCount, (p + 1) * childCount).
+			// Row-major levels are released as soon as they are reordered.
+
+			m_levels.resize(rowMajorLevels.size());
+			m_levels.back().swap(rowMajorLevels.back());
+
+			std::vector<ivec2> parentPositions(1, ivec2(0));
+			for (size_t level = m_levels.size() - 1; level != 0; --level)
+			{
+				const size_t childLevel = level - 1;
+				const ivec2 childSize = levelSizes[childLevel];
+				const ivec2 scale = m_levelScales[childLevel];
+				const u32 childCount = scale.x * scale.y;
+				const bool needChildPositions = childLevel != 0;
+
+				std::vector<float>& child = m_levels[childLevel];
+				std::vector<ivec2> childPositions(needChildPositions ? childSize.x * childSize.y : 0);
+				child.resize(childSize.x * childSize.y);
+
+				for (u32 parentIndex = 0; parentIndex < (u32)parentPositions.size(); ++parentIndex)
+				{
+					for (u32 i = 0; i < childCount; ++i)
+					{
+						ivec2 childPos = parentPositions[parentIndex] * scale + getChildOffset(i, scale);
+						child[parentIndex * childCount + i] = getRowMajor(childLevel, childPos);
+						if (needChildPositions)
+						{
+							childPositions[parentIndex * childCount + i] = childPos;
+						}
+					}
+				}
+
+				std::vector<float>().swap(rowMajorLevels[childLevel]);
+				parentPositions.swap(childPositions);
+			}
+		}
+
+		// Maps uniform random number u in [0, 1) to a weight index (x + y * width) and outputs its probability.
+		// u is kept in weight units while descending, so no rescaling is needed between levels.
+		u32 sample(double u, float& outProbability) const
+		{
+			double threshold = u * getWeightSum();
+			u32 index = 0;
+			ivec2 pos = ivec2(0);
+
+			for (size_t level = m_levels.size() - 1; level != 0; --level)
+			{
+				const ivec2 scale = m_levelScales[level - 1];
+				const u32 childCount = scale.x * scale.y;
+				const float* children = &m_levels[level - 1][index * childCount];
+
+				// Descendants three levels below are contiguous and are fetched ahead to hide memory latency
+				if (level >= 3)
+				{
+					const u32 descendantCount = childCount * getChildCount(level - 2) * getChildCount(level - 3);
+					const float* descendants = &m_levels[level - 3][index * descendantCount];
+					for (u32 i = 0; i < descendantCount; i += 16)
+					{
+						prefetch(descendants + i);
+					}
+				}
+
+				// Branchless search, since the chosen child is effectively random and would defeat branch prediction
+				u32 chosen = 0;
+				double chosenPrefix = 0.0;
+				double prefix = 0.0;
+				for (u32 i = 0; i < childCount - 1; ++i)
+				{
+					prefix += children[i];
+					bool above = threshold >= prefix;
+					chosen += above;
+					chosenPrefix = above ? prefix : chosenPrefix;
+				}
+				threshold -= chosenPrefix;
+
+				// Rounding may push threshold past the last non-zero child
+				while (children[chosen] == 0.0f && chosen != 0)
+				{
+					--chosen;
+				}
+
+				index = index * childCount + chosen;
+				pos = pos * scale + getChildOffset(chosen, scale);
+			}
+
+			outProbability = m_levels[0][index] / getWeightSum();
+			return pos.x + pos.y * m_size.x;
+		}
+
+		template <typename Rng>
+		u32 operator()(Rng& rng, float& outProbability) const
+		{
+			return sample(randomUnitDouble(rng), outProbability);
+		}
+
+		float getWeightSum() const { return m_levels.back()[0]; }
+
+		// Memory used by the pyramid, including padding
+		u64 getSizeBytes() const
+		{
+			u64 result = 0;
+			for (const std::vector<float>& level : m_levels)
+			{
+				result += level.size() * sizeof(float);
+			}
+			return result;
+		}
+
+	private:
+
+		static int nextPowerOfTwo(int x)
+		{
+			int result = 1;
+			while (result < x)
+			{
+				result *= 2;
+			}
+			return result;
+		}
+
+		u32 getChildCount(size_t level) const
+		{
+			return m_levelScales[level].x * m_levelScales[level].y;
+		}
+
+		static void prefetch(const float* p)
+		{
+#if defined(_MSC_VER)
+			_mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+			__builtin_prefetch(p);
+#endif
+		}
+
+		// Scale is either 1 or 2 in each dimension, so child offsets can be decoded with bit operations
+		static ivec2 getChildOffset(u32 i, ivec2 scale)
+		{
+			return ivec2(i & (scale.x - 1), i >> (scale.x - 1));
+		}
+
+		ivec2 m_size;
+		std::vector<ivec2> m_levelScales; // size ratio between m_levels[i] and m_levels[i + 1]
+		std::vector<std::vector<float>> m_levels; // m_levels[0] holds the weights, the last level holds their sum
+	};
+}
@@ -1,4 +1,5 @@
 #include "Image.h"
+#include "Trace.h"
 
 #include <stb_image_write.h>
 #include <stb_image.h>
@@ -8,6 +9,7 @@ namespace Probulator
 {
 	void Image::writePng(const char* filename) const
 	{
+		PROBULATOR_TRACE_SCOPE("Image::writePng");
 		if (m_pixels.empty()) return;
 		std::vector<u32> imageLdr(m_size.x * m_size.y);
 		for (size_t i = 0; i < imageLdr.size(); ++i)
@@ -40,6 +42,7 @@ namespace Probulator
 
 	bool Image::readHdr(const char* filename)
 	{
+		PROBULATOR_TRACE_SCOPE("Image::readHdr");
 		int w, h, comp;
 		float* imageData = stbi_loadf(filename, &w, &h, &comp, 3);
 		if (!imageData)
@@ -77,6 +80,7 @@ namespace Probulator
 
 	Image imageResize(const Image& input, ivec2 newSize)
 	{
+		PROBULATOR_TRACE_SCOPE("imageResize");
 		Image output(newSize);
 		stbir_resize_float(input.data(), input.getWidth(), input.getHeight(), (int)input.getStrideBytes(), 
 			output.data(), output.getWidth(), output.getHeight(), (int)output.getStrideBytes(), 4);
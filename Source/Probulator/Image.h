@@ -96,16 +96,20 @@ namespace Probulator
 			}
 		}
 
-		// Invoke fun(PixelType& pixel, ivec2 position) over all pixels in parallel
-		template <typename T> inline void parallelForPixels2D(T fun)
+		// Invoke fun(PixelType& pixel, ivec2 position) over all pixels in parallel.
+		// Work is distributed in tiles of at least rowGrainSize full rows.
+		template <typename T> inline void parallelForPixels2D(T fun, u32 rowGrainSize = 1)
 		{
-			u32 pixelCount = m_size.x * m_size.y;
-			parallelFor(0u, pixelCount, [&](u32 i)
+			parallelForRange(0u, (u32)m_size.y, rowGrainSize, [&](const ParallelRange& range)
 			{
-				u32 y = i / m_size.x;
-				u32 x = i % m_size.x;
-				ivec2 pos(x, y);
-				fun(at(pos), pos);
+				for (int y = (int)range.begin; y != (int)range.end; ++y)
+				{
+					PixelType* row = &m_pixels[y * m_size.x];
+					for (int x = 0; x < m_size.x; ++x)
+					{
+						fun(row[x], ivec2(x, y));
+					}
+				}
 			});
 		}
 
@@ -0,0 +1,94 @@
+#include "Json.h"
+
+#include <stdlib.h>
+
+namespace Probulator
+{
+	void jsonWriteString(FILE* f, const char* str)
+	{
+		fputc('"', f);
+		for (const char* c = str; *c; ++c)
+		{
+			switch (*c)
+			{
+			case '"': fputs("\\\"", f); break;
+			case '\\': fputs("\\\\", f); break;
+			case '\n': fputs("\\n", f); break;
+			case '\r': fputs("\\r", f); break;
+			case '\t': fputs("\\t", f); break;
+			default:
+				if ((unsigned char)*c < 0x20) fprintf(f, "\\u%04x", (unsigned char)*c);
+				else fputc(*c, f);
+				break;
+			}
+		}
+		fputc('"', f);
+	}
+
+	const char* jsonReadString(const char* str, std::string& outValue)
+	{
+		outValue.clear();
+		if (*str != '"')
+		{
+			return nullptr;
+		}
+
+		for (const char* c = str + 1; *c; ++c)
+		{
+			if (*c == '"')
+			{
+				return c + 1;
+			}
+
+			if (*c != '\\')
+			{
+				outValue.push_back(*c);
+				continue;
+			}
+
+			switch (*++c)
+			{
+			case '"': outValue.push_back('"'); break;
+			case '\\': outValue.push_back('\\'); break;
+			case '/': outValue.push_back('/'); break;
+			case 'b': outValue.push_back('\b'); break;
+			case 'f': outValue.push_back('\f'); break;
+			case 'n': outValue.push_back('\n'); break;
+			case 'r': outValue.push_back('\r'); break;
+			case 't': outValue.push_back('\t'); break;
+			case 'u':
+			{
+				// Only code points written by jsonWriteString are supported, anything else is kept as UTF-8
+				char digits[5] = {};
+				for (int i = 0; i < 4; ++i)
+				{
+					if (!c[1 + i]) return nullptr;
+					digits[i] = c[1 + i];
+				}
+				u32 code = (u32)strtoul(digits, nullptr, 16);
+				c += 4;
+				if (code < 0x80)
+				{
+					outValue.push_back((char)code);
+				}
+				else if (code < 0x800)
+				{
+					outValue.push_back((char)(0xC0 | (code >> 6)));
+					outValue.push_back((char)(0x80 | (code & 0x3F)));
+				}
+				else
+				{
+					outValue.push_back((char)(0xE0 | (code >> 12)));
+					outValue.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+					outValue.push_back((char)(0x80 | (code & 0x3F)));
+				}
+				break;
+			}
+			default:
+				return nullptr;
+			}
+		}
+
+		return nullptr;
+	}
+}
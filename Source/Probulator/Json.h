@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Common.h"
+
+#include <stdio.h>
+#include <string>
+
+namespace Probulator
+{
+	// Minimal JSON string support for the trace and benchmark writers
+
+	// Writes str in quotes, escaping quotes, backslashes and control characters
+	void jsonWriteString(FILE* f, const char* str);
+
+	// Reads a string written by jsonWriteString. str must point at the opening quote.
+	// Returns a pointer past the closing quote, or nullptr if the string is malformed.
+	const char* jsonReadString(const char* str, std::string& outValue);
+}
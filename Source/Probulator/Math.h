@@ -260,6 +260,140 @@ namespace Probulator
 		return sampleCosineHemisphere(uv.x, uv.y);
 	}
 
+	// PCG32 random number generator with 16 bytes of state (http://www.pcg-random.org).
+	// Cheap enough to create per work item and usable with std distributions.
+	struct Pcg32
+	{
+		typedef u32 result_type;
+
+		Pcg32(u64 seedValue = 0, u64 stream = 0)
+		{
+			seed(seedValue, stream);
+		}
+
+		void seed(u64 seedValue, u64 stream = 0)
+		{
+			m_state = 0;
+			m_increment = (stream << 1u) | 1u;
+			(*this)();
+			m_state += seedValue;
+			(*this)();
+		}
+
+		u32 operator()()
+		{
+			u64 oldState = m_state;
+			m_state = oldState * 6364136223846793005ull + m_increment;
+			u32 xorShifted = u32(((oldState >> 18u) ^ oldState) >> 27u);
+			u32 rotation = u32(oldState >> 59u);
+			return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+		}
+
+		static constexpr u32 min() { return 0; }
+		static constexpr u32 max() { return ~0u; }
+
+		u64 m_state;
+		u64 m_increment;
+	};
+
+	// Philox4x32-10 counter-based random number generator
+	// Salmon et al. 2011, "Parallel Random Numbers: As Easy as 1, 2, 3"
+	inline void philox4x32(const u32 counter[4], const u32 key[2], u32 out[4])
+	{
+		u32 c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+		u32 k0 = key[0], k1 = key[1];
+
+		for (u32 roundIt = 0; roundIt < 10; ++roundIt)
+		{
+			u64 p0 = u64(0xD2511F53u) * c0;
+			u64 p1 = u64(0xCD9E8D57u) * c2;
+			u32 hi0 = u32(p0 >> 32u), lo0 = u32(p0);
+			u32 hi1 = u32(p1 >> 32u), lo1 = u32(p1);
+
+			c0 = hi1 ^ c1 ^ k0;
+			c1 = lo1;
+			c2 = hi0 ^ c3 ^ k1;
+			c3 = lo0;
+
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	// Deterministic random numbers for one work item, such as a pixel or a child in a population.
+	// Numbers are a pure function of (seed, item, position), so streams cost nothing to create
+	// and results do not depend on how work is partitioned across threads.
+	class RandomStream
+	{
+	public:
+
+		typedef u32 result_type;
+
+		RandomStream(u64 seed, u64 item, u64 position = 0)
+		{
+			m_key[0] = u32(seed);
+			m_key[1] = u32(seed >> 32u);
+			m_counter[2] = u32(item);
+			m_counter[3] = u32(item >> 32u);
+			seek(position);
+		}
+
+		// Continue from the given number index within the stream
+		void seek(u64 position)
+		{
+			u64 block = position / 4;
+			m_counter[0] = u32(block);
+			m_counter[1] = u32(block >> 32u);
+			philox4x32(m_counter, m_key, m_block);
+			m_blockIndex = u32(position % 4);
+		}
+
+		u32 operator()()
+		{
+			if (m_blockIndex == 4)
+			{
+				if (++m_counter[0] == 0)
+				{
+					++m_counter[1];
+				}
+				philox4x32(m_counter, m_key, m_block);
+				m_blockIndex = 0;
+			}
+			return m_block[m_blockIndex++];
+		}
+
+		static constexpr u32 min() { return 0; }
+		static constexpr u32 max() { return ~0u; }
+
+	private:
+
+		u32 m_key[2];
+		u32 m_counter[4]; // block index in elements 0 and 1, item in elements 2 and 3
+		u32 m_block[4];
+		u32 m_blockIndex;
+	};
+
+	// Uniform float in [0, 1) from a generator of 32 bit random numbers
+	template <typename Rng>
+	inline float randomUnitFloat(Rng& rng)
+	{
+		return float(u32(rng()) >> 8u) * (1.0f / 16777216.0f);
+	}
+
+	// Uniform double in [0, 1) with full 53 bit precision, using two 32 bit random numbers
+	template <typename Rng>
+	inline double randomUnitDouble(Rng& rng)
+	{
+		u64 hi = u32(rng()) >> 5u;
+		u64 lo = u32(rng()) >> 6u;
+		return double((hi << 26u) | lo) * (1.0 / 9007199254740992.0);
+	}
+
 	inline float rgbLuminance(const vec3& color)
 	{
 		return dot(vec3(0.2126f, 0.7152f, 0.0722f), color);
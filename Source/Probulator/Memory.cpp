@@ -0,0 +1,471 @@
+#include "Memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <new>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Psapi.h>
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Probulator
+{
+	struct MemoryCounters
+	{
+		std::atomic<u64> allocatedBytes{ 0 };
+		std::atomic<u64> allocationCount{ 0 };
+		std::atomic<u64> currentBytes{ 0 };
+		std::atomic<u64> peakBytes{ 0 };
+
+		void add(u64 size)
+		{
+			allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+			allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+			const u64 current = currentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+			u64 peak = peakBytes.load(std::memory_order_relaxed);
+			while (current > peak && !peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		void remove(u64 size)
+		{
+			currentBytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+
+		void reset()
+		{
+			allocatedBytes = 0;
+			allocationCount = 0;
+			peakBytes = currentBytes.load();
+		}
+
+		MemoryStats getStats() const
+		{
+			MemoryStats result;
+			result.allocatedBytes = allocatedBytes;
+			result.allocationCount = allocationCount;
+			result.currentBytes = currentBytes;
+			result.peakBytes = peakBytes;
+			return result;
+		}
+	};
+
+	// Constant-initialized, so that allocations made before static constructors run can be tracked
+	struct MemoryAccount
+	{
+		constexpr explicit MemoryAccount(const char* accountName) : name(accountName) {}
+
+		const char* name;
+		MemoryCounters total;
+		MemoryCounters phases[MemoryPhase_Count];
+	};
+
+	namespace
+	{
+		MemoryAccount g_defaultAccount("Unattributed");
+
+		thread_local MemoryContext t_memoryContext = { nullptr, MemoryPhase_Other };
+
+		// Accounts and the registry itself are intentionally leaked, since memory may be freed during static destruction
+		struct MemoryAccountRegistry
+		{
+			std::mutex mutex;
+			std::map<std::string, MemoryAccount*> accountMap;
+			std::vector<MemoryAccount*> accounts;
+		};
+
+		MemoryAccountRegistry& getRegistry()
+		{
+			static MemoryAccountRegistry* registry = new MemoryAccountRegistry;
+			return *registry;
+		}
+
+		void* systemAlignedMalloc(size_t size, size_t alignment)
+		{
+#ifdef _MSC_VER
+			return _aligned_malloc(size, alignment);
+#else
+			void* ptr = nullptr;
+			return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+		}
+
+		void systemAlignedFree(void* ptr)
+		{
+#ifdef _MSC_VER
+			_aligned_free(ptr);
+#else
+			free(ptr);
+#endif
+		}
+
+#if PROBULATOR_MEMORY_TRACKING
+
+		// Stored immediately before every tracked allocation
+		struct AllocationHeader
+		{
+			MemoryAccount* account;
+			u64 packed; // size << 16 | log2(offset from base to user pointer) << 8 | aligned << 4 | phase
+		};
+
+		static_assert(sizeof(AllocationHeader) <= 16, "Allocation header must fit in the minimum offset");
+		const size_t MinAllocationOffset = 16;
+
+		u32 log2(size_t x)
+		{
+			u32 result = 0;
+			while (x > 1)
+			{
+				x >>= 1;
+				++result;
+			}
+			return result;
+		}
+
+		// Alignment of 0 uses malloc, which is what operator new does by default
+		void* trackedAllocate(size_t size, size_t alignment)
+		{
+			const size_t offset = alignment > MinAllocationOffset ? alignment : MinAllocationOffset;
+			u8* base = (u8*)(alignment ? systemAlignedMalloc(size + offset, offset) : malloc(size + offset));
+			if (!base)
+			{
+				return nullptr;
+			}
+
+			const MemoryContext context = t_memoryContext;
+			MemoryAccount* account = context.account ? context.account : &g_defaultAccount;
+
+			u8* ptr = base + offset;
+			AllocationHeader* header = reinterpret_cast<AllocationHeader*>(ptr) - 1;
+			header->account = account;
+			header->packed = (u64(size) << 16) | (u64(log2(offset)) << 8) | (u64(alignment != 0) << 4) | u64(context.phase);
+
+			account->total.add(size);
+			account->phases[context.phase].add(size);
+
+			return ptr;
+		}
+
+		void trackedFree(void* ptr)
+		{
+			if (!ptr)
+			{
+				return;
+			}
+
+			const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(ptr) - 1;
+			MemoryAccount* account = header->account;
+			const u64 packed = header->packed;
+			const u64 size = packed >> 16;
+			const size_t offset = size_t(1) << ((packed >> 8) & 0xFF);
+			const bool aligned = ((packed >> 4) & 1) != 0;
+			const MemoryPhase phase = MemoryPhase(packed & 0xF);
+
+			account->total.remove(size);
+			account->phases[phase].remove(size);
+
+			u8* base = reinterpret_cast<u8*>(ptr) - offset;
+			if (aligned)
+			{
+				systemAlignedFree(base);
+			}
+			else
+			{
+				free(base);
+			}
+		}
+
+#endif // PROBULATOR_MEMORY_TRACKING
+
+#if defined(__linux__)
+		// Reads a value in kilobytes from /proc/self/status
+		u64 readProcStatus(const char* key)
+		{
+			FILE* f = fopen("/proc/self/status", "r");
+			if (!f)
+			{
+				return 0;
+			}
+
+			u64 result = 0;
+			const size_t keyLength = strlen(key);
+			char line[256];
+			while (fgets(line, sizeof(line), f))
+			{
+				if (!strncmp(line, key, keyLength) && line[keyLength] == ':')
+				{
+					result = strtoull(line + keyLength + 1, nullptr, 10) * 1024;
+					break;
+				}
+			}
+
+			fclose(f);
+			return result;
+		}
+#endif
+	}
+
+	const char* memoryGetPhaseName(MemoryPhase phase)
+	{
+		switch (phase)
+		{
+		case MemoryPhase_Other: return "Other";
+		case MemoryPhase_Projection: return "Projection";
+		case MemoryPhase_Solve: return "Solve";
+		case MemoryPhase_Reconstruction: return "Reconstruction";
+		default: return "Unknown";
+		}
+	}
+
+	MemoryAccount* memoryGetAccount(const std::string& name)
+	{
+		MemoryAccountRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		auto it = registry.accountMap.find(name);
+		if (it != registry.accountMap.end())
+		{
+			return it->second;
+		}
+
+		it = registry.accountMap.insert(std::make_pair(name, nullptr)).first;
+		it->second = new MemoryAccount(it->first.c_str()); // map keys are never moved
+		registry.accounts.push_back(it->second);
+		return it->second;
+	}
+
+	MemoryAccount* memoryGetDefaultAccount()
+	{
+		return &g_defaultAccount;
+	}
+
+	MemoryAccountStats memoryGetAccountStats(MemoryAccount* account)
+	{
+		MemoryAccountStats result;
+		result.name = account->name;
+		result.total = account->total.getStats();
+		for (u32 phase = 0; phase < MemoryPhase_Count; ++phase)
+		{
+			result.phases[phase] = account->phases[phase].getStats();
+		}
+		return result;
+	}
+
+	std::vector<MemoryAccountStats> memoryGetAllAccountStats()
+	{
+		MemoryAccountRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		std::vector<MemoryAccountStats> result;
+		result.push_back(memoryGetAccountStats(&g_defaultAccount));
+		for (MemoryAccount* account : registry.accounts)
+		{
+			result.push_back(memoryGetAccountStats(account));
+		}
+		return result;
+	}
+
+	void memoryResetCounters()
+	{
+		MemoryAccountRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		auto resetAccount = [](MemoryAccount* account)
+		{
+			account->total.reset();
+			for (MemoryCounters& counters : account->phases)
+			{
+				counters.reset();
+			}
+		};
+
+		resetAccount(&g_defaultAccount);
+		for (MemoryAccount* account : registry.accounts)
+		{
+			resetAccount(account);
+		}
+	}
+
+	MemoryContext memoryGetContext()
+	{
+		return t_memoryContext;
+	}
+
+	void memorySetContext(const MemoryContext& context)
+	{
+		t_memoryContext = context;
+	}
+
+	MemoryCharge::MemoryCharge(u64 size)
+		: m_context(t_memoryContext)
+		, m_size(size)
+	{
+		if (!m_context.account)
+		{
+			m_context.account = &g_defaultAccount;
+		}
+		m_context.account->total.add(m_size);
+		m_context.account->phases[m_context.phase].add(m_size);
+	}
+
+	MemoryCharge::~MemoryCharge()
+	{
+		m_context.account->total.remove(m_size);
+		m_context.account->phases[m_context.phase].remove(m_size);
+	}
+
+	void* memoryAllocate(size_t size, size_t alignment)
+	{
+		alignment = alignment > 16 ? alignment : 16;
+#if PROBULATOR_MEMORY_TRACKING
+		return trackedAllocate(size, alignment);
+#else
+		return systemAlignedMalloc(size, alignment);
+#endif
+	}
+
+	void memoryFree(void* ptr)
+	{
+#if PROBULATOR_MEMORY_TRACKING
+		trackedFree(ptr);
+#else
+		systemAlignedFree(ptr);
+#endif
+	}
+
+	u64 memoryGetResidentBytes()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined(__linux__)
+		return readProcStatus("VmRSS");
+#elif defined(__APPLE__)
+		mach_task_basic_info info;
+		mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+		if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+		{
+			return info.resident_size;
+		}
+		return 0;
+#else
+		return 0;
+#endif
+	}
+
+	u64 memoryGetPeakResidentBytes()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#elif defined(__linux__)
+		return readProcStatus("VmHWM"); // unlike ru_maxrss, this is reset by memoryResetPeakResidentBytes
+#else
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return (u64)usage.ru_maxrss; // bytes on macOS
+#endif
+	}
+
+	bool memoryResetPeakResidentBytes()
+	{
+#if defined(__linux__)
+		FILE* f = fopen("/proc/self/clear_refs", "w");
+		if (!f)
+		{
+			return false;
+		}
+		bool result = fputs("5", f) >= 0;
+		result &= fclose(f) == 0;
+		return result;
+#else
+		return false;
+#endif
+	}
+}
+
+#if PROBULATOR_MEMORY_TRACKING
+
+// Replacing the global allocation functions routes all operator new allocations through the tracker.
+// Sized deallocation is replaced as well, so every delete visibly goes through the tracker.
+
+void* operator new(size_t size)
+{
+	void* ptr = Probulator::trackedAllocate(size, 0);
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	void* ptr = Probulator::trackedAllocate(size, 0);
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return Probulator::trackedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return Probulator::trackedAllocate(size, 0);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	Probulator::trackedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	Probulator::trackedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	Probulator::trackedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	Probulator::trackedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	Probulator::trackedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	Probulator::trackedFree(ptr);
+}
+
+#endif // PROBULATOR_MEMORY_TRACKING
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Common.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Heap allocation accounting.
+// Every allocation made through operator new or AlignedAllocator is charged to the memory account and phase
+// of the calling thread (see MemoryScope). Parallel loops hand the context of the caller to their workers.
+// Eigen allocates matrix storage with std::malloc directly, so large matrices are charged explicitly (see MemoryCharge)
+// and the rest is only visible in resident memory queries.
+// Building with PROBULATOR_MEMORY_TRACKING=0 (CMake option) keeps the default operator new and removes the scopes.
+
+#ifndef PROBULATOR_MEMORY_TRACKING
+#define PROBULATOR_MEMORY_TRACKING 0
+#endif
+
+namespace Probulator
+{
+	enum MemoryPhase
+	{
+		MemoryPhase_Other,
+		MemoryPhase_Projection, // projecting input onto a basis, including basis evaluation
+		MemoryPhase_Solve, // fitting basis coefficients
+		MemoryPhase_Reconstruction, // evaluating the fitted basis at output texels
+
+		MemoryPhase_Count
+	};
+
+	const char* memoryGetPhaseName(MemoryPhase phase);
+
+	// Named set of allocation counters, typically one per experiment.
+	// Accounts are never destroyed, so pointers to them stay valid.
+	struct MemoryAccount;
+
+	// Returns the account with the given name, creating it on first use
+	MemoryAccount* memoryGetAccount(const std::string& name);
+
+	// Allocations made outside of any MemoryScope
+	MemoryAccount* memoryGetDefaultAccount();
+
+	struct MemoryStats
+	{
+		u64 allocatedBytes = 0; // sum of all allocation sizes
+		u64 allocationCount = 0;
+		u64 currentBytes = 0; // allocated and not yet freed
+		u64 peakBytes = 0; // highest currentBytes
+	};
+
+	struct MemoryAccountStats
+	{
+		std::string name;
+		MemoryStats total;
+		MemoryStats phases[MemoryPhase_Count];
+	};
+
+	MemoryAccountStats memoryGetAccountStats(MemoryAccount* account);
+
+	// All accounts in creation order, starting with the default account
+	std::vector<MemoryAccountStats> memoryGetAllAccountStats();
+
+	// Clears allocated bytes and counts of all accounts and resets peaks to current usage
+	void memoryResetCounters();
+
+	struct MemoryContext
+	{
+		MemoryAccount* account;
+		MemoryPhase phase;
+	};
+
+	MemoryContext memoryGetContext();
+	void memorySetContext(const MemoryContext& context);
+
+	// Changes the account or phase of the calling thread until the end of the scope.
+	// Entering an account starts with MemoryPhase_Other, entering a phase keeps the current account.
+	class MemoryScope
+	{
+	public:
+
+		explicit MemoryScope(const MemoryContext& context) : m_previous(memoryGetContext()) { memorySetContext(context); }
+		explicit MemoryScope(MemoryAccount* account) : MemoryScope(MemoryContext{ account, MemoryPhase_Other }) {}
+		explicit MemoryScope(const std::string& accountName) : MemoryScope(memoryGetAccount(accountName)) {}
+		explicit MemoryScope(MemoryPhase phase) : MemoryScope(MemoryContext{ memoryGetContext().account, phase }) {}
+		~MemoryScope() { memorySetContext(m_previous); }
+
+		MemoryScope(const MemoryScope&) = delete;
+		MemoryScope& operator=(const MemoryScope&) = delete;
+
+	private:
+
+		MemoryContext m_previous;
+	};
+
+	// Charges memory allocated outside of operator new, such as Eigen matrix storage, to the account and phase
+	// of the calling thread until the end of the scope. Used where such allocations dominate memory use.
+	class MemoryCharge
+	{
+	public:
+
+		explicit MemoryCharge(u64 size);
+		~MemoryCharge();
+
+		MemoryCharge(const MemoryCharge&) = delete;
+		MemoryCharge& operator=(const MemoryCharge&) = delete;
+
+	private:
+
+		MemoryContext m_context;
+		u64 m_size;
+	};
+
+	// Bytes used by a dynamic Eigen matrix or vector
+	template <typename M>
+	inline u64 memoryGetMatrixBytes(const M& m)
+	{
+		return u64(m.size()) * sizeof(typename M::Scalar);
+	}
+
+	// Tracked allocation with alignment of at least 16 bytes. Memory must be released with memoryFree.
+	void* memoryAllocate(size_t size, size_t alignment);
+	void memoryFree(void* ptr);
+
+	// Resident set size of the process, 0 where not supported
+	u64 memoryGetResidentBytes();
+
+	// Highest resident set size since the process started or since memoryResetPeakResidentBytes
+	u64 memoryGetPeakResidentBytes();
+
+	// Returns false if the platform does not support resetting the peak
+	bool memoryResetPeakResidentBytes();
+}
+
+#if PROBULATOR_MEMORY_TRACKING
+#define PROBULATOR_MEMORY_CONCAT_(a, b) a##b
+#define PROBULATOR_MEMORY_CONCAT(a, b) PROBULATOR_MEMORY_CONCAT_(a, b)
+#define PROBULATOR_MEMORY_SCOPE(accountOrPhase) ::Probulator::MemoryScope PROBULATOR_MEMORY_CONCAT(memoryScope, __LINE__)(accountOrPhase)
+#define PROBULATOR_MEMORY_CHARGE(size) ::Probulator::MemoryCharge PROBULATOR_MEMORY_CONCAT(memoryCharge, __LINE__)(size)
+#else
+#define PROBULATOR_MEMORY_SCOPE(accountOrPhase) ((void)0)
+#define PROBULATOR_MEMORY_CHARGE(size) ((void)0)
+#endif
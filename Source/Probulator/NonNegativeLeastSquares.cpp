@@ -0,0 +1,246 @@
+#include "NonNegativeLeastSquares.h"
+#include "Trace.h"
+
+#include <Eigen/Eigen>
+#include <algorithm>
+#include <vector>
+
+namespace Probulator
+{
+	namespace
+	{
+		typedef Eigen::Matrix<u8, Eigen::Dynamic, Eigen::Dynamic> PassiveMatrix;
+
+		// Unconstrained least squares solution restricted to the passive variables of columns that share the same passive set.
+		// Writes zero to all other variables.
+		void solvePassive(const Eigen::MatrixXd& ata, const Eigen::MatrixXd& atb, const PassiveMatrix& passive,
+			const std::vector<u32>& columns, Eigen::MatrixXd& z)
+		{
+			using namespace Eigen;
+
+			const u32 variableCount = u32(ata.rows());
+			const u32 firstColumn = columns.front();
+
+			std::vector<u32> variables;
+			for (u32 i = 0; i < variableCount; ++i)
+			{
+				if (passive(i, firstColumn)) variables.push_back(i);
+			}
+
+			for (u32 c : columns)
+			{
+				z.col(c).setZero();
+			}
+
+			if (variables.empty())
+			{
+				return;
+			}
+
+			const u32 n = u32(variables.size());
+			MatrixXd subAta(n, n);
+			MatrixXd subAtb(n, columns.size());
+			for (u32 i = 0; i < n; ++i)
+			{
+				for (u32 j = 0; j < n; ++j)
+				{
+					subAta(i, j) = ata(variables[i], variables[j]);
+				}
+				for (u32 c = 0; c < columns.size(); ++c)
+				{
+					subAtb(i, c) = atb(variables[i], columns[c]);
+				}
+			}
+
+			// LDLT handles the semi-definite Gram matrices of nearly dependent variables
+			MatrixXd subX = subAta.ldlt().solve(subAtb);
+			for (u32 c = 0; c < columns.size(); ++c)
+			{
+				for (u32 i = 0; i < n; ++i)
+				{
+					z(variables[i], columns[c]) = subX(i, c);
+				}
+			}
+		}
+
+		// Solves the passive systems of all given columns, factorizing once per distinct passive set
+		void solvePassiveGrouped(const Eigen::MatrixXd& ata, const Eigen::MatrixXd& atb, const PassiveMatrix& passive,
+			const std::vector<u32>& columns, Eigen::MatrixXd& z)
+		{
+			std::vector<bool> solved(columns.size(), false);
+			std::vector<u32> group;
+			for (u32 i = 0; i < columns.size(); ++i)
+			{
+				if (solved[i]) continue;
+
+				group.clear();
+				for (u32 j = i; j < columns.size(); ++j)
+				{
+					if (!solved[j] && passive.col(columns[j]) == passive.col(columns[i]))
+					{
+						group.push_back(columns[j]);
+						solved[j] = true;
+					}
+				}
+
+				solvePassive(ata, atb, passive, group, z);
+			}
+		}
+	}
+
+	Eigen::MatrixXd nnlsSolveNormalEquations(const Eigen::MatrixXd& ata, const Eigen::MatrixXd& atb,
+		NnlsActiveSet& activeSet, u32 maxIterations)
+	{
+		PROBULATOR_TRACE_SCOPE("nnlsSolveNormalEquations");
+		using namespace Eigen;
+
+		const u32 variableCount = u32(ata.rows());
+		const u32 columnCount = u32(atb.cols());
+
+		if (maxIterations == 0)
+		{
+			maxIterations = 3 * variableCount;
+		}
+
+		PassiveMatrix& passive = activeSet.passive;
+		if (passive.rows() != variableCount || passive.cols() != columnCount)
+		{
+			passive.setZero(variableCount, columnCount);
+		}
+		activeSet.iterationCount = 0;
+
+		MatrixXd x = MatrixXd::Zero(variableCount, columnCount);
+		MatrixXd z(variableCount, columnCount);
+
+		// Gradient components below this are treated as zero, relative to the magnitude of Atb
+		VectorXd tolerance(columnCount);
+		for (u32 c = 0; c < columnCount; ++c)
+		{
+			tolerance[c] = 1e-10 * atb.col(c).cwiseAbs().maxCoeff();
+		}
+
+		std::vector<u32> pending;
+		std::vector<u32> stillPending;
+
+		// Warm start: x = 0 is feasible for any passive set, so the initial sets only need to be shrunk
+		// until their unconstrained solutions are positive. Each pass removes at least one variable.
+
+		for (u32 c = 0; c < columnCount; ++c)
+		{
+			if ((passive.col(c).array() != 0).any()) pending.push_back(c);
+		}
+
+		while (!pending.empty())
+		{
+			solvePassiveGrouped(ata, atb, passive, pending, z);
+
+			stillPending.clear();
+			for (u32 c : pending)
+			{
+				bool feasible = true;
+				for (u32 i = 0; i < variableCount; ++i)
+				{
+					if (passive(i, c) && z(i, c) <= 0.0)
+					{
+						passive(i, c) = 0;
+						feasible = false;
+					}
+				}
+
+				if (feasible) x.col(c) = z.col(c);
+				else stillPending.push_back(c);
+			}
+			pending.swap(stillPending);
+		}
+
+		// Lawson-Hanson iterations
+
+		std::vector<u32> unfinished(columnCount);
+		for (u32 c = 0; c < columnCount; ++c)
+		{
+			unfinished[c] = c;
+		}
+
+		while (activeSet.iterationCount < maxIterations)
+		{
+			// Free the clamped variable with the largest positive gradient, columns without one are optimal
+
+			pending.clear();
+			for (u32 c : unfinished)
+			{
+				VectorXd w = atb.col(c) - ata * x.col(c);
+				u32 best = variableCount;
+				double bestGradient = tolerance[c];
+				for (u32 i = 0; i < variableCount; ++i)
+				{
+					if (!passive(i, c) && w[i] > bestGradient)
+					{
+						best = i;
+						bestGradient = w[i];
+					}
+				}
+
+				if (best != variableCount)
+				{
+					passive(best, c) = 1;
+					pending.push_back(c);
+				}
+			}
+
+			if (pending.empty())
+			{
+				break;
+			}
+
+			unfinished = pending;
+			activeSet.iterationCount++;
+
+			// Move towards the unconstrained solution until it is feasible, clamping variables that reach zero on the way
+
+			while (!pending.empty())
+			{
+				solvePassiveGrouped(ata, atb, passive, pending, z);
+
+				stillPending.clear();
+				for (u32 c : pending)
+				{
+					double alpha = 1.0;
+					u32 blocking = variableCount;
+					for (u32 i = 0; i < variableCount; ++i)
+					{
+						if (passive(i, c) && z(i, c) <= 0.0)
+						{
+							double t = x(i, c) / (x(i, c) - z(i, c));
+							if (blocking == variableCount || t < alpha)
+							{
+								alpha = t;
+								blocking = i;
+							}
+						}
+					}
+
+					if (blocking == variableCount)
+					{
+						x.col(c) = z.col(c);
+						continue;
+					}
+
+					x.col(c) += alpha * (z.col(c) - x.col(c));
+					x(blocking, c) = 0.0;
+					for (u32 i = 0; i < variableCount; ++i)
+					{
+						if (passive(i, c) && x(i, c) <= 0.0)
+						{
+							passive(i, c) = 0;
+							x(i, c) = 0.0;
+						}
+					}
+					stillPending.push_back(c);
+				}
+				pending.swap(stillPending);
+			}
+		}
+
+		return x;
+	}
+}
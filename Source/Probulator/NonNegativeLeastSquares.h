@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Common.h"
+
+#include <Eigen/Core>
+
+namespace Probulator
+{
+	// Active set of a non-negative least squares solve, one column per right hand side.
+	// Passive variables are free to take positive values, all other variables are clamped to zero.
+	struct NnlsActiveSet
+	{
+		Eigen::Matrix<u8, Eigen::Dynamic, Eigen::Dynamic> passive;
+		u32 iterationCount = 0; // outer iterations of the last solve, 0 if the warm start was already optimal
+	};
+
+	// Minimizes |A * x - b|^2 subject to x >= 0 for every column of b, given only AtA and Atb.
+	// Their size only depends on the variable count, so the cost of a solve does not depend on sample count.
+	// Uses the Lawson-Hanson active set method. Columns (typically color channels) are solved together:
+	// columns with the same passive set share one factorization per iteration (Van Benthem and Keenan, 2004).
+	// If activeSet holds the result of a previous solve of the same size, it is used as the initial passive set.
+	// Solves of similar problems, such as neighbouring probes, then usually take one or two iterations.
+	// The active set is updated with the result.
+	Eigen::MatrixXd nnlsSolveNormalEquations(const Eigen::MatrixXd& ata, const Eigen::MatrixXd& atb,
+		NnlsActiveSet& activeSet, u32 maxIterations = 0); // 0 for 3 * variable count
+}
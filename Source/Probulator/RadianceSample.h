@@ -1,6 +1,11 @@
 #pragma once
 
 #include "Math.h"
+#include "AlignedAllocator.h"
+
+#include <initializer_list>
+#include <utility>
+#include <vector>
 
 namespace Probulator
 {
@@ -9,4 +14,78 @@ namespace Probulator
 		vec3 direction;
 		vec3 value;
 	};
+
+	// Radiance samples stored as separate component streams.
+	// Streams are 32-byte aligned and zero-padded to a multiple of LaneCount elements,
+	// so kernels can always load whole SIMD registers. Padding elements must not contribute to results.
+	class RadianceSampleArray
+	{
+	public:
+
+		static const u32 Alignment = 32;
+		static const u32 LaneCount = 8;
+
+		typedef std::vector<float, AlignedAllocator<float, Alignment>> Stream;
+
+		RadianceSampleArray() {}
+		explicit RadianceSampleArray(u32 count) { resize(count); }
+
+		u32 size() const { return m_size; }
+		u32 getPaddedSize() const { return (u32)directionX.size(); }
+		bool empty() const { return m_size == 0; }
+
+		// New samples are zero-initialized
+		void resize(u32 count)
+		{
+			const u32 paddedCount = (count + LaneCount - 1) & ~(LaneCount - 1);
+			for (Stream* stream : { &directionX, &directionY, &directionZ, &valueR, &valueG, &valueB })
+			{
+				stream->resize(m_size < count ? m_size : count); // drop old padding so it gets zeroed
+				stream->resize(paddedCount, 0.0f);
+			}
+			m_size = count;
+		}
+
+		void clear()
+		{
+			resize(0);
+		}
+
+		void swap(RadianceSampleArray& other)
+		{
+			directionX.swap(other.directionX);
+			directionY.swap(other.directionY);
+			directionZ.swap(other.directionZ);
+			valueR.swap(other.valueR);
+			valueG.swap(other.valueG);
+			valueB.swap(other.valueB);
+			std::swap(m_size, other.m_size);
+		}
+
+		vec3 getDirection(u32 index) const { return vec3(directionX[index], directionY[index], directionZ[index]); }
+		vec3 getValue(u32 index) const { return vec3(valueR[index], valueG[index], valueB[index]); }
+
+		RadianceSample operator[](u32 index) const { return { getDirection(index), getValue(index) }; }
+
+		void set(u32 index, const RadianceSample& sample)
+		{
+			directionX[index] = sample.direction.x;
+			directionY[index] = sample.direction.y;
+			directionZ[index] = sample.direction.z;
+			valueR[index] = sample.value.r;
+			valueG[index] = sample.value.g;
+			valueB[index] = sample.value.b;
+		}
+
+		Stream directionX;
+		Stream directionY;
+		Stream directionZ;
+		Stream valueR;
+		Stream valueG;
+		Stream valueB;
+
+	private:
+
+		u32 m_size = 0;
+	};
 }
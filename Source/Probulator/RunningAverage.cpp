@@ -0,0 +1,88 @@
+#include "RunningAverage.h"
+
+namespace Probulator
+{
+	SgRunningAverageState::SgRunningAverageState(const SgBasis& lobes, bool nonNegative)
+		: m_initialLobes(lobes)
+		, m_nonNegative(nonNegative)
+	{
+		const u32 lobeCount = (u32)lobes.size();
+
+		m_lobePrecomputedSphericalIntegrals.resize(lobeCount);
+		for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+		{
+			const float lambda = lobes[lobeIt].lambda;
+			m_lobePrecomputedSphericalIntegrals[lobeIt] = (1.f - exp(-4.f * lambda)) / (4 * lambda);
+		}
+
+		reset();
+	}
+
+	void SgRunningAverageState::reset()
+	{
+		m_lobes = m_initialLobes;
+		m_lobeMCSphericalIntegrals.assign(m_lobes.size(), 0.0f);
+		m_sampleCount = 0;
+	}
+
+	void SgRunningAverageState::addSamples(const RadianceSampleArray& samples)
+	{
+		const u32 lobeCount = (u32)m_lobes.size();
+
+		// Lobe weights only depend on lobe axes and sharpness, which do not change,
+		// so they are evaluated for blocks of samples up front with the batched SG kernel
+		const u32 BlockSize = 256;
+		m_blockLobeWeights.resize(lobeCount * BlockSize);
+
+		for (u32 sampleIt = 0; sampleIt < samples.size(); ++sampleIt)
+		{
+			const u32 blockSampleIt = sampleIt % BlockSize;
+			if (blockSampleIt == 0)
+			{
+				const u32 blockSize = std::min(BlockSize, samples.size() - sampleIt);
+				sgEvaluateBatch(m_lobes.data(), lobeCount,
+					&samples.directionX[sampleIt], &samples.directionY[sampleIt], &samples.directionZ[sampleIt],
+					blockSize, m_blockLobeWeights.data(), BlockSize);
+			}
+
+			const vec3 sampleValue = samples.getValue(sampleIt);
+			++m_sampleCount;
+			const float sampleWeightScale = float(1.0 / double(m_sampleCount));
+
+			vec3 currentEstimate = vec3(0.f);
+			for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+			{
+				currentEstimate += m_lobes[lobeIt].mu * m_blockLobeWeights[lobeIt * BlockSize + blockSampleIt];
+			}
+
+			for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+			{
+				float weight = m_blockLobeWeights[lobeIt * BlockSize + blockSampleIt];
+				if (weight == 0.f) { continue; }
+
+				float sphericalIntegralGuess = weight * weight;
+
+				// Update the MC-computed integral of the lobe over the domain.
+				m_lobeMCSphericalIntegrals[lobeIt] += (sphericalIntegralGuess - m_lobeMCSphericalIntegrals[lobeIt]) * sampleWeightScale;
+
+				// The most accurate method requires using the MC-computed integral,
+				// since then bias in the estimate will partially cancel out.
+				// However, if you don't want to store a weight per-lobe you can instead substitute it with the
+				// precomputed integral at a slight increase in error.
+
+				// Clamp the MC-computed integral to within a reasonable ad-hoc factor of the actual integral to avoid noise.
+				float sphericalIntegral = max(m_lobeMCSphericalIntegrals[lobeIt], m_lobePrecomputedSphericalIntegrals[lobeIt] * 0.75f);
+
+				vec3 otherLobesContribution = currentEstimate - m_lobes[lobeIt].mu * weight;
+				vec3 newValue = (sampleValue - otherLobesContribution) * weight / sphericalIntegral;
+
+				m_lobes[lobeIt].mu += (newValue - m_lobes[lobeIt].mu) * sampleWeightScale;
+
+				if (m_nonNegative)
+				{
+					m_lobes[lobeIt].mu = max(m_lobes[lobeIt].mu, vec3(0.f));
+				}
+			}
+		}
+	}
+}
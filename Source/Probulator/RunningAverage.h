@@ -0,0 +1,115 @@
+#pragma once
+
+#include "HBasis.h"
+#include "RadianceSample.h"
+#include "SGBasis.h"
+
+#include <vector>
+
+namespace Probulator
+{
+	// Progressive probe estimators that keep their state between batches of radiance samples.
+	// Samples can be added every frame (e.g. by a path tracer) and the current estimate read at any time
+	// without solving from scratch. Samples are expected to be uniformly distributed over the sphere.
+
+	// Progressive least squares fit of SG amplitudes for fixed lobe axes and sharpness.
+	// Reference: http://torust.me/rendering/irradiance-caching/spherical-gaussians/2018/09/21/spherical-gaussians.html
+	class SgRunningAverageState
+	{
+	public:
+
+		SgRunningAverageState() {}
+
+		// Lobe axes and sharpness stay fixed, amplitudes are the initial estimate (usually zero)
+		explicit SgRunningAverageState(const SgBasis& lobes, bool nonNegative = false);
+
+		// Forgets all samples and restores the initial amplitudes
+		void reset();
+
+		// Samples are processed in order, the estimate depends on the order but not on how samples are split into batches
+		void addSamples(const RadianceSampleArray& samples);
+
+		SgBasis snapshot() const { return m_lobes; }
+
+		u64 getSampleCount() const { return m_sampleCount; }
+
+	private:
+
+		SgBasis m_initialLobes;
+		SgBasis m_lobes;
+		std::vector<float> m_lobeMCSphericalIntegrals;
+		std::vector<float> m_lobePrecomputedSphericalIntegrals;
+		std::vector<float> m_blockLobeWeights;
+		u64 m_sampleCount = 0;
+		bool m_nonNegative = false;
+	};
+
+	// Monte Carlo projection of radiance onto a linear basis, the mean of 4 pi * value * basis(direction)
+	// over all samples so far. Coefficients is HBasisT<vec3, L> or a similar array of Size vec3 elements.
+	template <typename Coefficients, size_t Size>
+	class ProjectionRunningAverageState
+	{
+	public:
+
+		ProjectionRunningAverageState()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			for (size_t i = 0; i < Size; ++i)
+			{
+				m_sums[i] = glm::dvec3(0.0);
+			}
+			m_sampleCount = 0;
+		}
+
+		Coefficients snapshot() const
+		{
+			const double scale = m_sampleCount ? fourPi / double(m_sampleCount) : 0.0;
+			Coefficients result;
+			for (size_t i = 0; i < Size; ++i)
+			{
+				result[i] = vec3(m_sums[i] * scale);
+			}
+			return result;
+		}
+
+		u64 getSampleCount() const { return m_sampleCount; }
+
+	protected:
+
+		// basis[i] is basis function i at the sample direction.
+		// Sums are kept in double precision, as a float sum or running mean stops
+		// taking small contributions into account once millions of samples were added.
+		template <typename T>
+		void addSample(const T& basis, vec3 value)
+		{
+			++m_sampleCount;
+			const glm::dvec3 sampleValue(value);
+			for (size_t i = 0; i < Size; ++i)
+			{
+				m_sums[i] += sampleValue * double(basis[i]);
+			}
+		}
+
+		glm::dvec3 m_sums[Size];
+		u64 m_sampleCount = 0;
+	};
+
+	template <size_t L>
+	class HBasisRunningAverageState : public ProjectionRunningAverageState<HBasisT<vec3, L>, L>
+	{
+	public:
+
+		void addSamples(const RadianceSampleArray& samples)
+		{
+			for (u32 sampleIt = 0; sampleIt < samples.size(); ++sampleIt)
+			{
+				const RadianceSample sample = samples[sampleIt];
+				this->addSample(hEvaluate<L>(sample.direction), sample.value);
+			}
+		}
+	};
+}
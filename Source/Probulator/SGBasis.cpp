@@ -1,6 +1,8 @@
 #include "SGBasis.h"
 #include "Variance.h"
 
+#include <algorithm>
+
 namespace Probulator
 {
 	vec3 sgBasisEvaluate(const SgBasis& basis, vec3 direction)
@@ -53,22 +55,54 @@ namespace Probulator
 		outVariance = accumulator.getVariance();
 	}
 
-	vec3 sgBasisMeanSquareError(const SgBasis& basis, const std::vector<RadianceSample>& radianceSamples)
+	vec3 sgBasisMeanSquareError(const SgBasis& basis, const RadianceSampleArray& radianceSamples)
 	{
-		vec3 errorSquaredSum = vec3(0.0f);
+		const u32 LaneCount = RadianceSampleArray::LaneCount;
+		const u32 BlockSize = 32 * LaneCount;
+
+		// Reconstruction is done over blocks of samples with the batched SG kernel.
+		// Squared errors are accumulated in one partial sum per SIMD lane.
+		float reconstructed[3][BlockSize];
+		float errorSquaredSum[3][LaneCount] = {};
+
+		const u32 sampleCount = radianceSamples.size();
 
-		for (const RadianceSample& sample : radianceSamples)
+		for (u32 blockBegin = 0; blockBegin < sampleCount; blockBegin += BlockSize)
 		{
-			vec3 reconstructedValue = sgBasisEvaluate(basis, sample.direction);
-			vec3 error = sample.value - reconstructedValue;
-			errorSquaredSum += error*error;
+			const u32 validSize = std::min(BlockSize, sampleCount - blockBegin);
+
+			sgEvaluateSumBatch(basis.data(), u32(basis.size()),
+				&radianceSamples.directionX[blockBegin], &radianceSamples.directionY[blockBegin], &radianceSamples.directionZ[blockBegin],
+				validSize, reconstructed[0], reconstructed[1], reconstructed[2]);
+
+			const float* values[3] =
+			{
+				&radianceSamples.valueR[blockBegin],
+				&radianceSamples.valueG[blockBegin],
+				&radianceSamples.valueB[blockBegin],
+			};
+
+			for (u32 channelIt = 0; channelIt < 3; ++channelIt)
+			{
+				for (u32 i = 0; i < validSize; ++i)
+				{
+					float error = values[channelIt][i] - reconstructed[channelIt][i];
+					errorSquaredSum[channelIt][i % LaneCount] += error * error;
+				}
+			}
 		}
 
-		float sampleWeight = 1.0f / radianceSamples.size();
-		return errorSquaredSum * sampleWeight;
+		vec3 result = vec3(0.0f);
+		for (u32 laneIt = 0; laneIt < LaneCount; ++laneIt)
+		{
+			result += vec3(errorSquaredSum[0][laneIt], errorSquaredSum[1][laneIt], errorSquaredSum[2][laneIt]);
+		}
+
+		float sampleWeight = 1.0f / sampleCount;
+		return result * sampleWeight;
 	}
 
-	float sgBasisMeanSquareErrorScalar(const SgBasis& basis, const std::vector<RadianceSample>& radianceSamples)
+	float sgBasisMeanSquareErrorScalar(const SgBasis& basis, const RadianceSampleArray& radianceSamples)
 	{
 		return dot(sgBasisMeanSquareError(basis, radianceSamples), vec3(1.0f / 3.0f));
 	}
@@ -84,4 +118,161 @@ namespace Probulator
         return result / pi;
     }
 
-}
\ No newline at end of file
+
+	namespace
+	{
+		float maxAbsComponent(const vec3& v)
+		{
+			return std::max(std::max(abs(v.x), abs(v.y)), abs(v.z));
+		}
+
+		SgLobeCone makeCone(float angle)
+		{
+			return { angle, cos(angle), sin(angle) };
+		}
+
+		// Finds the cone of a lobe with contribution(cosine) that does not decrease with the cosine
+		// between lobe axis and direction, using bisection
+		template <typename F>
+		SgLobeCone findCone(F contribution, float threshold)
+		{
+			if (contribution(1.0f) < threshold) return makeCone(-1.0f);
+			if (abs(contribution(-1.0f)) >= threshold) return makeCone(pi);
+
+			float lo = -1.0f;
+			float hi = 1.0f;
+			for (u32 i = 0; i < 24; ++i)
+			{
+				float mid = 0.5f * (lo + hi);
+				if (contribution(mid) < threshold) lo = mid;
+				else hi = mid;
+			}
+			return makeCone(acos(lo));
+		}
+
+		template <typename F>
+		SgBasisCones findCones(const SgBasis& basis, float threshold, F unitContribution)
+		{
+			float peakSum = 0.0f;
+			for (const SphericalGaussian& lobe : basis)
+			{
+				peakSum += maxAbsComponent(lobe.mu) * abs(unitContribution(lobe.lambda, 1.0f));
+			}
+
+			SgBasisCones cones(basis.size());
+			for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
+			{
+				const SphericalGaussian& lobe = basis[lobeIt];
+				const float scale = maxAbsComponent(lobe.mu);
+				if (threshold <= 0.0f)
+				{
+					cones[lobeIt] = makeCone(pi);
+				}
+				else if (scale == 0.0f)
+				{
+					cones[lobeIt] = makeCone(-1.0f);
+				}
+				else
+				{
+					cones[lobeIt] = findCone([&](float cosine) { return unitContribution(lobe.lambda, cosine); }, threshold * peakSum / scale);
+				}
+			}
+			return cones;
+		}
+
+		vec3 directionWithCosine(float cosine)
+		{
+			return vec3(sqrt(std::max(0.0f, 1.0f - cosine * cosine)), 0.0f, cosine);
+		}
+	}
+
+	SgBasisCones sgBasisRadianceCones(const SgBasis& basis, float threshold)
+	{
+		return findCones(basis, threshold, [](float lambda, float cosine)
+		{
+			return exp(lambda * (cosine - 1.0f));
+		});
+	}
+
+	SgBasisCones sgBasisIrradianceCones(const SgBasis& basis, float brdfLambda, float threshold)
+	{
+		if (brdfLambda > 0.0f)
+		{
+			SphericalGaussian brdf;
+			brdf.p = vec3(0.0f, 0.0f, 1.0f);
+			brdf.lambda = brdfLambda;
+			brdf.mu = vec3(sgFindMu(brdfLambda, pi));
+
+			return findCones(basis, threshold, [&](float lambda, float cosine)
+			{
+				SphericalGaussian lobe;
+				lobe.p = directionWithCosine(cosine);
+				lobe.lambda = lambda;
+				lobe.mu = vec3(1.0f);
+				return sgDot(lobe, brdf).x / pi;
+			});
+		}
+		else
+		{
+			return findCones(basis, threshold, [](float lambda, float cosine)
+			{
+				SphericalGaussian lobe;
+				lobe.p = directionWithCosine(cosine);
+				lobe.lambda = lambda;
+				lobe.mu = vec3(1.0f);
+				return sgIrradianceFitted(lobe, vec3(0.0f, 0.0f, 1.0f)).x / pi;
+			});
+		}
+	}
+
+	void sgBasisCullLobes(const SgBasis& basis, const SgBasisCones& cones,
+		const float* x, const float* y, const float* z, u32 count, std::vector<u32>& outLobeIndices)
+	{
+		outLobeIndices.clear();
+
+		vec3 center = vec3(0.0f);
+		for (u32 i = 0; i < count; ++i)
+		{
+			center += vec3(x[i], y[i], z[i]);
+		}
+
+		// Directions that do not fit in a hemisphere are not worth culling
+		const float centerLength = length(center);
+		float directionsCos = 1.0f;
+		if (centerLength > 0.0f)
+		{
+			center /= centerLength;
+			for (u32 i = 0; i < count; ++i)
+			{
+				directionsCos = std::min(directionsCos, x[i] * center.x + y[i] * center.y + z[i] * center.z);
+			}
+		}
+		if (centerLength == 0.0f || directionsCos <= 0.0f)
+		{
+			for (u32 lobeIt = 0; lobeIt < u32(basis.size()); ++lobeIt)
+			{
+				if (cones[lobeIt].angle >= 0.0f) outLobeIndices.push_back(lobeIt);
+			}
+			return;
+		}
+
+		const float directionsAngle = acos(directionsCos);
+		const float directionsSin = sqrt(1.0f - directionsCos * directionsCos);
+
+		for (u32 lobeIt = 0; lobeIt < u32(basis.size()); ++lobeIt)
+		{
+			const SgLobeCone& cone = cones[lobeIt];
+			if (cone.angle < 0.0f) continue;
+
+			// Cones overlap if the angle between their axes is below the sum of their angles
+			bool overlap = cone.angle + directionsAngle >= pi;
+			if (!overlap)
+			{
+				const float sumCos = cone.cosAngle * directionsCos - cone.sinAngle * directionsSin;
+				overlap = dot(basis[lobeIt].p, center) >= sumCos;
+			}
+
+			if (overlap) outLobeIndices.push_back(lobeIt);
+		}
+	}
+}
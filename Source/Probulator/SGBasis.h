@@ -13,7 +13,28 @@ namespace Probulator
 	vec3 sgBasisEvaluate(const SgBasis& basis, vec3 direction);
 	vec3 sgBasisDot(const SgBasis& basis, const SphericalGaussian& lobe);
 	void sgBasisMeanAndVariance(const SphericalGaussian* lobes, u32 lobeCount, u32 sampleCount, vec3& outMean, vec3& outVariance);
-	vec3 sgBasisMeanSquareError(const SgBasis& basis, const std::vector<RadianceSample>& radianceSamples);
-	float sgBasisMeanSquareErrorScalar(const SgBasis& basis, const std::vector<RadianceSample>& radianceSamples);
+	vec3 sgBasisMeanSquareError(const SgBasis& basis, const RadianceSampleArray& radianceSamples);
+	float sgBasisMeanSquareErrorScalar(const SgBasis& basis, const RadianceSampleArray& radianceSamples);
     vec3 sgBasisIrradianceFitted(const SgBasis& basis, const vec3& normal);
+
+	// Region around a lobe axis outside of which the lobe contributes less than a threshold to every color channel
+	struct SgLobeCone
+	{
+		float angle; // negative if the lobe can be skipped everywhere, pi if it can not be skipped anywhere
+		float cosAngle;
+		float sinAngle;
+	};
+
+	typedef std::vector<SgLobeCone> SgBasisCones;
+
+	// Cones for reconstructing radiance (sgBasisEvaluate) and irradiance (sgBasisDot with a BRDF lobe of the given
+	// sharpness, or sgBasisIrradianceFitted if it is 0). Threshold is relative to the sum of lobe peak values,
+	// which bounds the reconstructed values. Threshold 0 disables culling.
+	SgBasisCones sgBasisRadianceCones(const SgBasis& basis, float threshold);
+	SgBasisCones sgBasisIrradianceCones(const SgBasis& basis, float brdfLambda, float threshold);
+
+	// Collects indices of lobes whose cones overlap the bounding cone of count directions
+	// given as separate x, y and z arrays
+	void sgBasisCullLobes(const SgBasis& basis, const SgBasisCones& cones,
+		const float* x, const float* y, const float* z, u32 count, std::vector<u32>& outLobeIndices);
 }
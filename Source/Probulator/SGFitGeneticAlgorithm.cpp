@@ -1,5 +1,7 @@
 #include "SGFitGeneticAlgorithm.h"
 #include "Thread.h"
+#include "Memory.h"
+#include "Trace.h"
 
 #include <random>
 #include <algorithm>
@@ -7,13 +9,15 @@
 
 namespace Probulator
 {
-	inline float randomFloat(std::mt19937& rng, float min = 0.0f, float max = 1.0f)
+	template <typename Rng>
+	inline float randomFloat(Rng& rng, float min = 0.0f, float max = 1.0f)
 	{
 		std::uniform_real_distribution<float> uniformDistribution(min, max);
 		return uniformDistribution(rng);
 	}
 
-	inline u32 randomUint(std::mt19937& rng, u32 min = 0, u32 max = ~0u)
+	template <typename Rng>
+	inline u32 randomUint(Rng& rng, u32 min = 0, u32 max = ~0u)
 	{
 		std::uniform_int_distribution<u32> uniformDistribution(min, max);
 		return uniformDistribution(rng);
@@ -21,14 +25,15 @@ namespace Probulator
 
 	inline float errorFunction(
 		const SgBasis& basis,
-		const std::vector<RadianceSample>& samples)
+		const RadianceSampleArray& samples)
 	{
 		vec3 mse = sgBasisMeanSquareError(basis, samples);
 		vec3 rgbLuminance = vec3(0.2126f, 0.7152f, 0.0722f);
 		return dot(mse, rgbLuminance);
 	}
 
-	static void mutate(SgBasis& basis, float mutationRate, float sigma, std::mt19937& rng)
+	template <typename Rng>
+	static void mutate(SgBasis& basis, float mutationRate, float sigma, Rng& rng)
 	{
 		std::normal_distribution<float> normalDistribution(0.0f, sigma);
 		for (SphericalGaussian& lobe : basis)
@@ -48,120 +53,222 @@ namespace Probulator
 		}
 	}
 
-	static SgBasis crossOver(const SgBasis& a, const SgBasis& b, std::mt19937& rng)
+	// Writes the child into preallocated storage of the same size as the parents
+	template <typename Rng>
+	static void crossOver(const SgBasis& a, const SgBasis& b, SgBasis& result, Rng& rng)
 	{
 		u32 crossoverPoint = randomUint(rng, 0, (u32)a.size());
 
-		SgBasis result;
+		std::copy(a.begin(), a.begin() + crossoverPoint, result.begin());
+		std::copy(b.begin() + crossoverPoint, b.end(), result.begin() + crossoverPoint);
+	}
 
-		for (u64 lobeIt = 0; lobeIt < crossoverPoint; ++lobeIt)
-		{
-			result.push_back(a[lobeIt]);
-		}
-		for (u64 lobeIt = crossoverPoint; lobeIt < a.size(); ++lobeIt)
+	namespace
+	{
+		// All storage is allocated up front and reused for every generation
+		struct GaIsland
 		{
-			result.push_back(b[lobeIt]);
-		}
+			GaIsland(const SgBasis& basis, u32 populationCount, float basisError, u64 seed, u32 islandIndex)
+				: population(populationCount, basis)
+				, nextPopulation(populationCount, basis)
+				, error(populationCount, basisError)
+				, nextError(populationCount, basisError)
+				, fitness(populationCount)
+				, cumulativeFitness(populationCount)
+				, sortedIndices(populationCount)
+				, rng(seed, islandIndex)
+			{
+			}
+
+			void sortByError()
+			{
+				for (u32 i = 0; i < sortedIndices.size(); ++i)
+				{
+					sortedIndices[i] = i;
+				}
+
+				std::sort(sortedIndices.begin(), sortedIndices.end(), [&](u32 a, u32 b)
+				{
+					return error[a] < error[b];
+				});
+			}
+
+			float getMinError() const { return error[sortedIndices.front()]; }
 
-		return result;
+			std::vector<SgBasis> population;
+			std::vector<SgBasis> nextPopulation;
+			std::vector<float> error; // negative for individuals that were not evaluated yet
+			std::vector<float> nextError;
+			std::vector<double> fitness;
+			std::vector<double> cumulativeFitness;
+			std::vector<u32> sortedIndices;
+			RandomStream rng;
+		};
 	}
 
 	SgBasis sgFitGeneticAlgorithm(
 		const SgBasis& basis,
-		const std::vector<RadianceSample>& samples,
-		u32 populationCount,
-		u32 generationCount,
-		u32 seed,
-		bool verbose)
+		const RadianceSampleArray& samples,
+		const SgGeneticAlgorithmSettings& settings)
 	{
-		std::mt19937 rng(seed);
-
-		std::vector<SgBasis> population;
-		std::vector<SgBasis> nextPopulation;
+		PROBULATOR_TRACE_SCOPE("sgFitGeneticAlgorithm");
+		PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
 
 		const float mutationRate = 0.05f;
 		const float mutationSigma = 0.025f;
 		const u32 eliteCount = 1;
 
-		population.reserve(populationCount);
-		nextPopulation.reserve(populationCount);
+		const u32 islandCount = std::max(settings.islandCount, 1u);
+		const u32 populationCount = std::max(settings.islandPopulationCount, eliteCount + 1);
+		const u32 migrantCount = std::min(settings.migrantCount, populationCount / 2); // best and worst must not overlap
 
-		for (u32 populationIt = 0; populationIt < populationCount; ++populationIt)
+		// Initial populations are copies of the input basis, so it only needs to be evaluated once
+		const float basisError = errorFunction(basis, samples);
+		if (basisError == 0.0f)
 		{
-			nextPopulation.push_back(basis);
+			return basis;
 		}
 
-		std::vector<float> populationError(populationCount);
-		std::vector<double> populationFitness(populationCount);
-		std::vector<u32> sortedSolutionIndices(populationCount);
+		std::vector<GaIsland> islands;
+		islands.reserve(islandCount);
+		for (u32 islandIt = 0; islandIt < islandCount; ++islandIt)
+		{
+			islands.emplace_back(basis, populationCount, basisError, settings.seed, islandIt);
+		}
+
+		float checkpointError = basisError;
+		u32 checkpointGeneration = 0;
 
-		for (u32 generationIt = 0; generationIt < generationCount; generationIt++)
+		for (u32 generationIt = 0; generationIt < settings.generationCount; generationIt++)
 		{
-			std::swap(population, nextPopulation);
+			for (GaIsland& island : islands)
+			{
+				std::swap(island.population, island.nextPopulation);
+				std::swap(island.error, island.nextError);
+			}
 
-			parallelFor(0u, populationCount, [&](u32 basisIt)
+			parallelFor(0u, islandCount * populationCount, [&](u32 individualIt)
 			{
-				populationError[basisIt] = errorFunction(population[basisIt], samples);
+				GaIsland& island = islands[individualIt / populationCount];
+				u32 basisIt = individualIt % populationCount;
+				if (island.error[basisIt] < 0.0f)
+				{
+					island.error[basisIt] = errorFunction(island.population[basisIt], samples);
+				}
 			});
 
-			for (u32 populationIt = 0; populationIt < populationCount; ++populationIt)
+			for (GaIsland& island : islands)
 			{
-				sortedSolutionIndices[populationIt] = populationIt;
+				island.sortByError();
 			}
 
-			std::sort(sortedSolutionIndices.begin(), sortedSolutionIndices.end(), [&](u32 a, u32 b)
+			if (settings.migrationInterval && generationIt % settings.migrationInterval == settings.migrationInterval - 1)
 			{
-				return populationError[a] < populationError[b];
-			});
+				// Ring topology, best individuals of every island replace the worst ones of the next island
+				for (u32 islandIt = 0; islandIt < islandCount && islandCount > 1; ++islandIt)
+				{
+					const GaIsland& source = islands[islandIt];
+					GaIsland& target = islands[(islandIt + 1) % islandCount];
+					for (u32 migrantIt = 0; migrantIt < migrantCount; ++migrantIt)
+					{
+						u32 sourceIndex = source.sortedIndices[migrantIt];
+						u32 targetIndex = target.sortedIndices[populationCount - 1 - migrantIt];
+						target.population[targetIndex] = source.population[sourceIndex];
+						target.error[targetIndex] = source.error[sourceIndex];
+					}
+				}
 
-			u32 minErrorSolutionIndex = sortedSolutionIndices.front();
-			u32 maxErrorSolutionIndex = sortedSolutionIndices.back();
+				for (GaIsland& island : islands)
+				{
+					island.sortByError();
+				}
+			}
 
-			float minError = populationError[minErrorSolutionIndex];
-			float maxError = populationError[maxErrorSolutionIndex];
+			float minError = islands.front().getMinError();
+			for (const GaIsland& island : islands)
+			{
+				minError = std::min(minError, island.getMinError());
+			}
 
 			if (minError == 0.0f)
 			{
-				return population[minErrorSolutionIndex];
+				break;
 			}
 
-			for (u32 populationIt = 0; populationIt < populationCount; ++populationIt)
+			if (minError < checkpointError * (1.0f - settings.convergenceThreshold))
 			{
-				float x = (maxError - populationError[populationIt]) / maxError;
-				populationFitness[populationIt] = 0.000001 + x * populationCount;
+				checkpointError = minError;
+				checkpointGeneration = generationIt;
+			}
+			else if (settings.stallGenerationCount && generationIt - checkpointGeneration >= settings.stallGenerationCount)
+			{
+				if (settings.verbose)
+				{
+					printf("Converged after %d generations, best solution error: %f\n", generationIt + 1, minError);
+				}
+				break;
 			}
 
-			if (verbose && generationIt%50 == 0)
+			if (settings.verbose && generationIt%50 == 0)
 			{
 				printf("Generation %d best solution error: %f\n", generationIt, minError);
 			}
 
-			nextPopulation.clear();
-			for (u32 eliteIt = 0; eliteIt < eliteCount; ++eliteIt)
+			if (generationIt + 1 == settings.generationCount)
 			{
-				nextPopulation.push_back(population[sortedSolutionIndices[eliteIt]]);
+				break; // keep the evaluated population
 			}
 
-#ifdef _MSC_VER
-			std::initializer_list<double> il(populationFitness.data(), populationFitness.data() + populationFitness.size());
-			std::discrete_distribution<u32> dd(il);
-#else
-			std::discrete_distribution<u32> dd(populationFitness.begin(), populationFitness.end());
-#endif
-
-			while (nextPopulation.size() < populationCount)
-			{
-				u32 idA = dd(rng);
-				u32 idB = dd(rng);
-				const SgBasis& a = population[idA];
-				const SgBasis& b = population[idB];
-				SgBasis nextBasis = crossOver(a, b, rng);
-				mutate(nextBasis, mutationRate, mutationSigma, rng);
-				nextPopulation.push_back(nextBasis);
+			parallelFor(0u, islandCount, [&](u32 islandIt)
+			{
+				GaIsland& island = islands[islandIt];
+
+				const float maxError = island.error[island.sortedIndices.back()];
+				double fitnessSum = 0.0;
+				for (u32 populationIt = 0; populationIt < populationCount; ++populationIt)
+				{
+					float x = (maxError - island.error[populationIt]) / maxError;
+					fitnessSum += 0.000001 + x * populationCount;
+					island.cumulativeFitness[populationIt] = fitnessSum;
+				}
+
+				for (u32 eliteIt = 0; eliteIt < eliteCount; ++eliteIt)
+				{
+					u32 eliteIndex = island.sortedIndices[eliteIt];
+					island.nextPopulation[eliteIt] = island.population[eliteIndex];
+					island.nextError[eliteIt] = island.error[eliteIndex];
+				}
+
+				// Fitness proportional selection
+				auto selectParent = [&]()
+				{
+					double x = randomFloat(island.rng) * fitnessSum;
+					auto it = std::upper_bound(island.cumulativeFitness.begin(), island.cumulativeFitness.end(), x);
+					return std::min(u32(it - island.cumulativeFitness.begin()), populationCount - 1);
+				};
+
+				for (u32 childIt = eliteCount; childIt < populationCount; ++childIt)
+				{
+					const SgBasis& a = island.population[selectParent()];
+					const SgBasis& b = island.population[selectParent()];
+					SgBasis& child = island.nextPopulation[childIt];
+					crossOver(a, b, child, island.rng);
+					mutate(child, mutationRate, mutationSigma, island.rng);
+					island.nextError[childIt] = -1.0f;
+				}
+			});
+		}
+
+		const GaIsland* bestIsland = &islands.front();
+		for (const GaIsland& island : islands)
+		{
+			if (island.getMinError() < bestIsland->getMinError())
+			{
+				bestIsland = &island;
 			}
 		}
 
-		return population[sortedSolutionIndices.front()];
+		return bestIsland->population[bestIsland->sortedIndices.front()];
 	}
 
 }
@@ -5,11 +5,28 @@
 
 namespace Probulator
 {
+	// Island model: the population is split into islands that evolve independently and in parallel,
+	// each from its own random stream. Every migrationInterval generations, the best individuals of every island
+	// replace the worst individuals of the next one. The result only depends on the seed, not on thread count.
+	struct SgGeneticAlgorithmSettings
+	{
+		u32 islandCount = 4;
+		u32 islandPopulationCount = 16;
+		u32 generationCount = 2000; // upper limit, see stallGenerationCount
+		u32 migrationInterval = 20; // in generations
+		u32 migrantCount = 2;
+
+		// Stops when the best error improved by less than convergenceThreshold (relative)
+		// over this many generations, 0 to always run generationCount generations
+		u32 stallGenerationCount = 100;
+		float convergenceThreshold = 1e-2f;
+
+		u64 seed = 0;
+		bool verbose = false;
+	};
+
 	SgBasis sgFitGeneticAlgorithm(
 		const SgBasis& basis,
-		const std::vector<RadianceSample>& samples,
-		u32 populationCount,
-		u32 generationCount,
-		u32 seed = 0,
-		bool verbose = false);
-}
\ No newline at end of file
+		const RadianceSampleArray& samples,
+		const SgGeneticAlgorithmSettings& settings);
+}
@@ -0,0 +1,252 @@
+#include "SGFitLBFGS.h"
+#include "Memory.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include <lbfgs.hpp>
+#include <stdio.h>
+
+namespace Probulator
+{
+	namespace
+	{
+		// Optimization variables of a lobe: amplitude (3), log of sharpness (1), unnormalized axis (3).
+		// Sharpness stays positive and the axis does not need to be kept normalized by the optimizer.
+		const u32 VariablesPerLobe = 7;
+
+		// Error and gradient sums over a range of samples. Scratch storage is reused for all blocks of the range.
+		struct SgGradientAccumulator
+		{
+			std::vector<double> sums; // error followed by gradient, see sgErrorAndGradient
+			std::vector<float> weights; // lobes x block samples
+			std::vector<float> cosines;
+		};
+
+		struct SgFitProblem
+		{
+			const RadianceSampleArray* samples;
+			SgBasis lobes; // lobes decoded from the variables that are currently evaluated
+			std::vector<float> axisLength;
+		};
+
+		void decodeLobes(const Eigen::VectorXd& x, SgFitProblem& problem)
+		{
+			for (u64 lobeIt = 0; lobeIt < problem.lobes.size(); ++lobeIt)
+			{
+				const double* v = &x[lobeIt * VariablesPerLobe];
+				SphericalGaussian& lobe = problem.lobes[lobeIt];
+				vec3 axis = vec3(float(v[4]), float(v[5]), float(v[6]));
+				float axisLength = length(axis);
+				lobe.mu = vec3(float(v[0]), float(v[1]), float(v[2]));
+				lobe.lambda = float(exp(v[3]));
+				lobe.p = axisLength > 0.0f ? axis / axisLength : vec3(0.0f, 0.0f, 1.0f);
+				problem.axisLength[lobeIt] = axisLength;
+			}
+		}
+
+		// Accumulates squared error sum and its partial derivatives with respect to amplitude, sharpness and
+		// normalized axis of every lobe over a block of samples. Derivatives are scaled by 0.5.
+		void accumulateBlock(SgGradientAccumulator& accumulator, const SgBasis& lobes,
+			const RadianceSampleArray& samples, u32 blockBegin, u32 count)
+		{
+			const u32 lobeCount = u32(lobes.size());
+			const float* directionX = &samples.directionX[blockBegin];
+			const float* directionY = &samples.directionY[blockBegin];
+			const float* directionZ = &samples.directionZ[blockBegin];
+			const float* values[3] = { &samples.valueR[blockBegin], &samples.valueG[blockBegin], &samples.valueB[blockBegin] };
+
+			accumulator.weights.resize(lobeCount * count);
+			accumulator.cosines.resize(lobeCount * count);
+
+			float residual[3][256];
+			for (u32 channelIt = 0; channelIt < 3; ++channelIt)
+			{
+				for (u32 i = 0; i < count; ++i)
+				{
+					residual[channelIt][i] = -values[channelIt][i];
+				}
+			}
+
+			sgEvaluateBatch(lobes.data(), lobeCount, directionX, directionY, directionZ, count, accumulator.weights.data(), count);
+
+			for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+			{
+				const SphericalGaussian& lobe = lobes[lobeIt];
+				const float* weights = &accumulator.weights[lobeIt * count];
+				float* cosines = &accumulator.cosines[lobeIt * count];
+				for (u32 i = 0; i < count; ++i)
+				{
+					const float w = weights[i];
+					cosines[i] = directionX[i] * lobe.p.x + directionY[i] * lobe.p.y + directionZ[i] * lobe.p.z;
+					residual[0][i] += lobe.mu.r * w;
+					residual[1][i] += lobe.mu.g * w;
+					residual[2][i] += lobe.mu.b * w;
+				}
+			}
+
+			double* sums = accumulator.sums.data();
+
+			float errorSum = 0.0f;
+			for (u32 i = 0; i < count; ++i)
+			{
+				errorSum += residual[0][i] * residual[0][i] + residual[1][i] * residual[1][i] + residual[2][i] * residual[2][i];
+			}
+			sums[0] += errorSum;
+
+			for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+			{
+				const SphericalGaussian& lobe = lobes[lobeIt];
+				const float* weights = &accumulator.weights[lobeIt * count];
+				const float* cosines = &accumulator.cosines[lobeIt * count];
+
+				float mu[3] = {}; // d/d mu
+				float lambda = 0.0f; // d/d lambda
+				float axis[3] = {}; // d/d p
+				for (u32 i = 0; i < count; ++i)
+				{
+					const float w = weights[i];
+					mu[0] += residual[0][i] * w;
+					mu[1] += residual[1][i] * w;
+					mu[2] += residual[2][i] * w;
+
+					// Derivative of the reconstruction with respect to w, projected on the residual
+					const float ew = w * (residual[0][i] * lobe.mu.r + residual[1][i] * lobe.mu.g + residual[2][i] * lobe.mu.b);
+					lambda += ew * (cosines[i] - 1.0f);
+					axis[0] += ew * directionX[i];
+					axis[1] += ew * directionY[i];
+					axis[2] += ew * directionZ[i];
+				}
+
+				double* lobeSums = sums + 1 + lobeIt * VariablesPerLobe;
+				lobeSums[0] += mu[0];
+				lobeSums[1] += mu[1];
+				lobeSums[2] += mu[2];
+				lobeSums[3] += lambda;
+				lobeSums[4] += axis[0] * lobe.lambda;
+				lobeSums[5] += axis[1] * lobe.lambda;
+				lobeSums[6] += axis[2] * lobe.lambda;
+			}
+		}
+
+		double sgErrorAndGradient(void* instance, const Eigen::VectorXd& x, Eigen::VectorXd& g)
+		{
+			PROBULATOR_TRACE_SCOPE("sgErrorAndGradient");
+
+			SgFitProblem& problem = *reinterpret_cast<SgFitProblem*>(instance);
+			const RadianceSampleArray& samples = *problem.samples;
+			decodeLobes(x, problem);
+
+			const u32 lobeCount = u32(problem.lobes.size());
+			const u32 sampleCount = samples.size();
+			const u32 BlockSize = 256;
+			const u32 blockCount = (sampleCount + BlockSize - 1) / BlockSize;
+
+			SgGradientAccumulator identity;
+			identity.sums.assign(1 + lobeCount * VariablesPerLobe, 0.0);
+
+			// Sums are reduced in a fixed order (see parallelReduce), so optimization does not depend on thread count
+			SgGradientAccumulator total = parallelReduce(0u, blockCount, 4, identity,
+				[&](SgGradientAccumulator& accumulator, u32 blockIt)
+			{
+				const u32 blockBegin = blockIt * BlockSize;
+				const u32 count = std::min(BlockSize, sampleCount - blockBegin);
+				accumulateBlock(accumulator, problem.lobes, samples, blockBegin, count);
+			},
+				[](const SgGradientAccumulator& a, const SgGradientAccumulator& b)
+			{
+				SgGradientAccumulator result;
+				result.sums = a.sums;
+				for (u64 i = 0; i < result.sums.size(); ++i)
+				{
+					result.sums[i] += b.sums[i];
+				}
+				return result;
+			});
+
+			// Error is the mean over samples and color channels, derivatives of squares give the factor of 2
+			const double errorScale = 1.0 / (3.0 * sampleCount);
+			const double gradientScale = 2.0 * errorScale;
+
+			for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+			{
+				const SphericalGaussian& lobe = problem.lobes[lobeIt];
+				const double* lobeSums = &total.sums[1 + lobeIt * VariablesPerLobe];
+				double* lobeGradient = &g[lobeIt * VariablesPerLobe];
+
+				lobeGradient[0] = gradientScale * lobeSums[0];
+				lobeGradient[1] = gradientScale * lobeSums[1];
+				lobeGradient[2] = gradientScale * lobeSums[2];
+				lobeGradient[3] = gradientScale * lobeSums[3] * lobe.lambda; // chain rule for log(lambda)
+
+				// Chain rule for p = q / |q|, only the component orthogonal to p changes the axis
+				const vec3 p = lobe.p;
+				const double gp[3] = { lobeSums[4], lobeSums[5], lobeSums[6] };
+				const double gpDotP = gp[0] * p.x + gp[1] * p.y + gp[2] * p.z;
+				const double axisScale = gradientScale / std::max(problem.axisLength[lobeIt], 1e-6f);
+				lobeGradient[4] = axisScale * (gp[0] - gpDotP * p.x);
+				lobeGradient[5] = axisScale * (gp[1] - gpDotP * p.y);
+				lobeGradient[6] = axisScale * (gp[2] - gpDotP * p.z);
+			}
+
+			return errorScale * total.sums[0];
+		}
+
+		int sgProgress(void*, const Eigen::VectorXd&, const Eigen::VectorXd&,
+			const double fx, const double, const int k, const int)
+		{
+			if (k % 10 == 0)
+			{
+				printf("Iteration %d error: %f\n", k, fx);
+			}
+			return 0;
+		}
+	}
+
+	SgBasis sgFitLBFGS(const SgBasis& basis, const RadianceSampleArray& samples, u32 maxIterations, bool verbose)
+	{
+		PROBULATOR_TRACE_SCOPE("sgFitLBFGS");
+		PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
+
+		if (basis.empty() || samples.size() == 0)
+		{
+			return basis;
+		}
+
+		SgFitProblem problem;
+		problem.samples = &samples;
+		problem.lobes = basis;
+		problem.axisLength.resize(basis.size());
+
+		Eigen::VectorXd x(basis.size() * VariablesPerLobe);
+		for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
+		{
+			const SphericalGaussian& lobe = basis[lobeIt];
+			double* v = &x[lobeIt * VariablesPerLobe];
+			v[0] = lobe.mu.r;
+			v[1] = lobe.mu.g;
+			v[2] = lobe.mu.b;
+			v[3] = log(std::max(lobe.lambda, 1e-3f)); // ambient lobes have zero sharpness
+			v[4] = lobe.p.x;
+			v[5] = lobe.p.y;
+			v[6] = lobe.p.z;
+		}
+
+		lbfgs::lbfgs_parameter_t param;
+		param.max_iterations = maxIterations;
+		param.g_epsilon = 0.0; // errors are small in absolute terms, rely on relative error decrease instead
+		param.past = 3;
+		param.delta = 1e-5;
+
+		double error = 0.0;
+		int status = lbfgs::lbfgs_optimize(x, error, sgErrorAndGradient, nullptr, verbose ? sgProgress : nullptr, &problem, param);
+
+		if (verbose)
+		{
+			printf("L-BFGS finished with error %f: %s\n", error, lbfgs::lbfgs_strerror(status));
+		}
+
+		// Line search failures still leave x at the best point found so far
+		decodeLobes(x, problem);
+		return problem.lobes;
+	}
+}
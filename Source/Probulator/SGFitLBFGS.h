@@ -0,0 +1,17 @@
+#pragma once
+
+#include "SGBasis.h"
+#include "RadianceSample.h"
+
+namespace Probulator
+{
+	// Jointly optimizes amplitude, sharpness and axis of all lobes to minimize the mean square error
+	// (average of color channels, see sgBasisMeanSquareErrorScalar) using L-BFGS with analytic gradients.
+	// Lobes are refined from their current values, so the input should already be a reasonable fit,
+	// such as the output of sgFitLeastSquares for a uniform lobe distribution.
+	SgBasis sgFitLBFGS(
+		const SgBasis& basis,
+		const RadianceSampleArray& samples,
+		u32 maxIterations = 200,
+		bool verbose = false);
+}
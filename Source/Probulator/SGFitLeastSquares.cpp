@@ -1,77 +1,172 @@
 #include "SGFitLeastSquares.h"
+#include "Memory.h"
+#include "Trace.h"
 #include <Eigen/Eigen>
-#include <Eigen/nnls.h>
 
 namespace Probulator
 {
-	SgBasis sgFitLeastSquares(const SgBasis& basis, const std::vector<RadianceSample>& samples)
+	// Builds the sample/lobe design matrix from SoA sample directions
+	static Eigen::MatrixXf sgBasisDesignMatrix(const SgBasis& basis, const RadianceSampleArray& samples)
 	{
+		PROBULATOR_TRACE_SCOPE("sgBasisDesignMatrix");
 		using namespace Eigen;
-		SgBasis result = basis;
 
+		const u32 sampleCount = samples.size();
+		const float* directionX = samples.directionX.data();
+		const float* directionY = samples.directionY.data();
+		const float* directionZ = samples.directionZ.data();
+
+		// Columns are contiguous, so they are the output planes of the batched SG kernel
 		MatrixXf A;
-		A.resize(samples.size(), basis.size());
-		for (u64 sampleIt = 0; sampleIt < samples.size(); ++sampleIt)
-		{
-			for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
-			{
-				A(sampleIt, lobeIt) = sgEvaluate(basis[lobeIt].p, basis[lobeIt].lambda, samples[sampleIt].direction);
-			}
-		}
+		A.resize(sampleCount, basis.size());
+		sgEvaluateBatch(basis.data(), u32(basis.size()), directionX, directionY, directionZ, sampleCount, A.data(), sampleCount);
+
+		return A;
+	}
 
+	static Eigen::Map<const Eigen::VectorXf> sgSampleChannel(const RadianceSampleArray& samples, u32 channelIt)
+	{
+		const RadianceSampleArray::Stream* channels[3] = { &samples.valueR, &samples.valueG, &samples.valueB };
+		return Eigen::Map<const Eigen::VectorXf>(channels[channelIt]->data(), samples.size());
+	}
+
+	// Sample values with one column per color channel
+	static Eigen::MatrixXf sgSampleValues(const RadianceSampleArray& samples)
+	{
+		Eigen::MatrixXf result(samples.size(), 3);
 		for (u32 channelIt = 0; channelIt < 3; ++channelIt)
 		{
-			VectorXf b;
-			b.resize(samples.size());
-			for (u64 sampleIt = 0; sampleIt < samples.size(); ++sampleIt)
-			{
-				b[sampleIt] = samples[sampleIt].value[channelIt];
-			}
+			result.col(channelIt) = sgSampleChannel(samples, channelIt);
+		}
+		return result;
+	}
 
-			VectorXf x = A.jacobiSvd(ComputeThinU | ComputeThinV).solve(b);
-			for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
-			{
-				result[lobeIt].mu[channelIt] = x[lobeIt];
-			}
+	SgBasis sgFitLeastSquares(const SgBasis& basis, const RadianceSampleArray& samples)
+	{
+		PROBULATOR_TRACE_SCOPE("sgFitLeastSquares");
+		PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
+		using namespace Eigen;
+		SgBasis result = basis;
+
+		MatrixXf A = sgBasisDesignMatrix(basis, samples);
+		PROBULATOR_MEMORY_CHARGE(memoryGetMatrixBytes(A));
+
+		MatrixXf b = sgSampleValues(samples);
+		PROBULATOR_MEMORY_CHARGE(memoryGetMatrixBytes(b));
+
+		// A single rank-revealing QR factorization is shared by all color channels.
+		// It is much cheaper than SVD for tall matrices and is as accurate for well conditioned lobe sets.
+		ColPivHouseholderQR<MatrixXf> qr(A);
+		PROBULATOR_MEMORY_CHARGE(memoryGetMatrixBytes(A)); // factorization keeps a copy of A
+		MatrixXf x = qr.solve(b);
+
+		for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
+		{
+			result[lobeIt].mu = vec3(x(lobeIt, 0), x(lobeIt, 1), x(lobeIt, 2));
 		}
 
 		return result;
 	}
 
-	// Non-negative version of least squares
-	SgBasis sgFitNNLeastSquares(const SgBasis& basis, const std::vector<RadianceSample>& samples)
+	// Non-negative version of least squares.
+	// Solved on the normal equations, which avoids storing the design matrix and its factorization.
+	SgBasis sgFitNNLeastSquares(const SgBasis& basis, const RadianceSampleArray& samples, NnlsActiveSet* activeSet)
+	{
+		PROBULATOR_TRACE_SCOPE("sgFitNNLeastSquares");
+		PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
+
+		SgNormalEquations equations = sgAccumulateNormalEquations(basis, samples);
+		return sgSolveNormalEquationsNonNegative(basis, equations, activeSet);
+	}
+
+	void sgAccumulateNormalEquations(SgNormalEquations& equations, const SgBasis& basis,
+		const float* directionX, const float* directionY, const float* directionZ,
+		const float* valueR, const float* valueG, const float* valueB, u32 count)
 	{
 		using namespace Eigen;
-		SgBasis result = basis;
 
-		MatrixXf A;
-		A.resize(samples.size(), basis.size());
-		for (u64 sampleIt = 0; sampleIt < samples.size(); ++sampleIt)
+		if (count == 0)
+			return;
+
+		const float* values[3] = { valueR, valueG, valueB };
+
+		// Lobe values of one block, reused for all blocks
+		const u32 blockCapacity = std::min(count, SgNormalEquationsBlockSize);
+		MatrixXf weights(blockCapacity, basis.size());
+
+		for (u32 blockBegin = 0; blockBegin < count; blockBegin += SgNormalEquationsBlockSize)
 		{
-			for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
+			const u32 blockSize = std::min(count - blockBegin, SgNormalEquationsBlockSize);
+			sgEvaluateBatch(basis.data(), u32(basis.size()),
+				directionX + blockBegin, directionY + blockBegin, directionZ + blockBegin, blockSize,
+				weights.data(), blockCapacity);
+
+			const auto blockWeights = weights.topRows(blockSize);
+			equations.ata += (blockWeights.transpose() * blockWeights).cast<double>();
+			for (u32 channelIt = 0; channelIt < 3; ++channelIt)
 			{
-				A(sampleIt, lobeIt) = sgEvaluate(basis[lobeIt].p, basis[lobeIt].lambda, samples[sampleIt].direction);
+				equations.atb.col(channelIt) += (blockWeights.transpose() * Map<const VectorXf>(values[channelIt] + blockBegin, blockSize)).cast<double>();
 			}
 		}
 
-		NNLS<MatrixXf> nnlssolver(A);
-		for (u32 channelIt = 0; channelIt < 3; ++channelIt)
+		equations.sampleCount += count;
+	}
+
+	SgNormalEquations sgAccumulateNormalEquations(const SgBasis& basis, const RadianceSampleArray& samples)
+	{
+		PROBULATOR_TRACE_SCOPE("sgAccumulateNormalEquations");
+
+		const u32 sampleCount = samples.size();
+		const u32 chunkSize = sgGetNormalEquationsChunkSize(sampleCount);
+		const u32 chunkCount = (sampleCount + chunkSize - 1) / chunkSize;
+
+		return parallelReduce(0u, chunkCount, 1, SgNormalEquations((u32)basis.size()),
+			[&](SgNormalEquations& equations, u32 chunkIt)
 		{
-			VectorXf b;
-			b.resize(samples.size());
-			for (u64 sampleIt = 0; sampleIt < samples.size(); ++sampleIt)
-			{
-				b[sampleIt] = samples[sampleIt].value[channelIt];
-			}
+			const u32 chunkBegin = chunkIt * chunkSize;
+			const u32 count = std::min(sampleCount - chunkBegin, chunkSize);
+			sgAccumulateNormalEquations(equations, basis,
+				&samples.directionX[chunkBegin], &samples.directionY[chunkBegin], &samples.directionZ[chunkBegin],
+				&samples.valueR[chunkBegin], &samples.valueG[chunkBegin], &samples.valueB[chunkBegin], count);
+		},
+		[](const SgNormalEquations& a, const SgNormalEquations& b)
+		{
+			SgNormalEquations result = a;
+			result += b;
+			return result;
+		});
+	}
+
+	SgBasis sgSolveNormalEquations(const SgBasis& basis, const SgNormalEquations& equations)
+	{
+		PROBULATOR_TRACE_SCOPE("sgSolveNormalEquations");
+		PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
+		using namespace Eigen;
 
-			// -- run the solver
-			nnlssolver.solve(b);
-			VectorXf x = nnlssolver.x();
+		SgBasis result = basis;
 
-			for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
-			{
-				result[lobeIt].mu[channelIt] = x[lobeIt];
-			}
+		MatrixXd x = equations.ata.ldlt().solve(equations.atb);
+		for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
+		{
+			result[lobeIt].mu = vec3(x(lobeIt, 0), x(lobeIt, 1), x(lobeIt, 2));
+		}
+
+		return result;
+	}
+
+	SgBasis sgSolveNormalEquationsNonNegative(const SgBasis& basis, const SgNormalEquations& equations, NnlsActiveSet* activeSet)
+	{
+		PROBULATOR_TRACE_SCOPE("sgSolveNormalEquationsNonNegative");
+		PROBULATOR_MEMORY_SCOPE(MemoryPhase_Solve);
+		using namespace Eigen;
+
+		SgBasis result = basis;
+
+		NnlsActiveSet localActiveSet;
+		MatrixXd x = nnlsSolveNormalEquations(equations.ata, equations.atb, activeSet ? *activeSet : localActiveSet);
+		for (u64 lobeIt = 0; lobeIt < basis.size(); ++lobeIt)
+		{
+			result[lobeIt].mu = vec3(x(lobeIt, 0), x(lobeIt, 1), x(lobeIt, 2));
 		}
 
 		return result;
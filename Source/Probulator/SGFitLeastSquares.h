@@ -1,14 +1,104 @@
 #pragma once
 
+#include "NonNegativeLeastSquares.h"
 #include "SGBasis.h"
 #include "RadianceSample.h"
+#include "Thread.h"
+
+#include <Eigen/Core>
 
 namespace Probulator
 {
 	SgBasis sgFitLeastSquares(
 		const SgBasis& basis,
-		const std::vector<RadianceSample>& samples);
+		const RadianceSampleArray& samples);
 	SgBasis sgFitNNLeastSquares(
 		const SgBasis& basis,
-		const std::vector<RadianceSample>& samples);
+		const RadianceSampleArray& samples,
+		NnlsActiveSet* activeSet = nullptr); // optional warm start, updated with the result
+
+	// Normal equations (AtA * x = Atb) of the least squares fit of lobe amplitudes to radiance samples,
+	// where A holds lobe values at sample directions. Their size only depends on the lobe count,
+	// so any number of samples can be accumulated without storing the samples or the design matrix.
+	struct SgNormalEquations
+	{
+		SgNormalEquations() {}
+		explicit SgNormalEquations(u32 lobeCount)
+			: ata(Eigen::MatrixXd::Zero(lobeCount, lobeCount))
+			, atb(Eigen::MatrixXd::Zero(lobeCount, 3))
+		{
+		}
+
+		SgNormalEquations& operator+=(const SgNormalEquations& other)
+		{
+			ata += other.ata;
+			atb += other.atb;
+			sampleCount += other.sampleCount;
+			return *this;
+		}
+
+		Eigen::MatrixXd ata; // lobes x lobes
+		Eigen::MatrixXd atb; // lobes x color channels
+		u64 sampleCount = 0;
+	};
+
+	// Samples are accumulated in blocks: products within a block are summed in single precision,
+	// block sums are added in double precision.
+	static const u32 SgNormalEquationsBlockSize = 256;
+
+	// Samples per parallel chunk of sgAccumulateNormalEquations, a multiple of SgNormalEquationsBlockSize.
+	// Chunks are at least 16 blocks and there are at most 256 of them.
+	inline u32 sgGetNormalEquationsChunkSize(u32 sampleCount)
+	{
+		const u32 blockCount = (sampleCount + SgNormalEquationsBlockSize - 1) / SgNormalEquationsBlockSize;
+		const u32 blocksPerChunk = (blockCount + 255) / 256 > 16 ? (blockCount + 255) / 256 : 16;
+		return blocksPerChunk * SgNormalEquationsBlockSize;
+	}
+
+	// Adds samples given as structure-of-arrays streams to the normal equations
+	void sgAccumulateNormalEquations(SgNormalEquations& equations, const SgBasis& basis,
+		const float* directionX, const float* directionY, const float* directionZ,
+		const float* valueR, const float* valueG, const float* valueB, u32 count);
+
+	// Accumulates in parallel chunks merged in a fixed order (see parallelReduce),
+	// so the result does not depend on thread count.
+	SgNormalEquations sgAccumulateNormalEquations(const SgBasis& basis, const RadianceSampleArray& samples);
+
+	// Accumulates normal equations of sampleCount samples produced on the fly by getSample(u32 sampleIndex) -> RadianceSample.
+	// Samples are generated and accumulated in parallel chunks like above. Memory use does not depend on sample count.
+	template <typename F>
+	inline SgNormalEquations sgAccumulateNormalEquations(const SgBasis& basis, u32 sampleCount, F getSample)
+	{
+		const u32 chunkSize = sgGetNormalEquationsChunkSize(sampleCount);
+		const u32 chunkCount = (sampleCount + chunkSize - 1) / chunkSize;
+
+		return parallelReduce(0u, chunkCount, 1, SgNormalEquations((u32)basis.size()),
+			[&](SgNormalEquations& equations, u32 chunkIt)
+		{
+			const u32 chunkBegin = chunkIt * chunkSize;
+			const u32 count = sampleCount - chunkBegin < chunkSize ? sampleCount - chunkBegin : chunkSize;
+
+			RadianceSampleArray samples(count);
+			for (u32 i = 0; i < count; ++i)
+			{
+				samples.set(i, getSample(chunkBegin + i));
+			}
+
+			sgAccumulateNormalEquations(equations, basis,
+				samples.directionX.data(), samples.directionY.data(), samples.directionZ.data(),
+				samples.valueR.data(), samples.valueG.data(), samples.valueB.data(), count);
+		},
+		[](const SgNormalEquations& a, const SgNormalEquations& b)
+		{
+			SgNormalEquations result = a;
+			result += b;
+			return result;
+		});
+	}
+
+	SgBasis sgSolveNormalEquations(const SgBasis& basis, const SgNormalEquations& equations);
+
+	// Non-negative solve of all color channels together (see nnlsSolveNormalEquations)
+	SgBasis sgSolveNormalEquationsNonNegative(const SgBasis& basis, const SgNormalEquations& equations,
+		NnlsActiveSet* activeSet = nullptr);
 }
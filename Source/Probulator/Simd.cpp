@@ -0,0 +1,117 @@
+#include "Simd.h"
+
+#include <atomic>
+
+#if PROBULATOR_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace Probulator
+{
+#if PROBULATOR_SIMD_X86
+	static void cpuid(u32 leaf, u32 subleaf, u32 regs[4])
+	{
+#ifdef _MSC_VER
+		int r[4];
+		__cpuidex(r, (int)leaf, (int)subleaf);
+		for (u32 i = 0; i < 4; ++i) regs[i] = (u32)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static u64 xgetbv0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		u32 eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((u64)edx << 32) | eax;
+#endif
+	}
+
+	static SimdIsa detectIsa()
+	{
+		u32 regs[4];
+
+		cpuid(0, 0, regs);
+		const u32 maxLeaf = regs[0];
+		if (maxLeaf < 7)
+			return SimdIsa_Scalar;
+
+		cpuid(1, 0, regs);
+		const bool fma = (regs[2] & (1u << 12)) != 0;
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const bool avx = (regs[2] & (1u << 28)) != 0;
+		if (!osxsave || !avx)
+			return SimdIsa_Scalar;
+
+		// OS must preserve YMM (and ZMM / opmask) registers across context switches
+		const u64 xcr0 = xgetbv0();
+		const bool osAvx = (xcr0 & 0x6) == 0x6;
+		const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+
+		cpuid(7, 0, regs);
+		const bool avx2 = (regs[1] & (1u << 5)) != 0;
+		const bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+		if (avx512f && osAvx512)
+			return SimdIsa_AVX512;
+
+		if (avx2 && fma && osAvx)
+			return SimdIsa_AVX2;
+
+		return SimdIsa_Scalar;
+	}
+#else
+	static SimdIsa detectIsa()
+	{
+		return SimdIsa_Scalar;
+	}
+#endif
+
+	static std::atomic<int> g_simdMaxIsa(SimdIsa_AVX512);
+
+	SimdIsa simdGetSupportedIsa()
+	{
+		static const SimdIsa supportedIsa = detectIsa();
+		return supportedIsa;
+	}
+
+	SimdIsa simdGetIsa()
+	{
+		const SimdIsa supportedIsa = simdGetSupportedIsa();
+		const SimdIsa maxIsa = (SimdIsa)g_simdMaxIsa.load(std::memory_order_relaxed);
+		return supportedIsa < maxIsa ? supportedIsa : maxIsa;
+	}
+
+	void simdSetMaxIsa(SimdIsa isa)
+	{
+		g_simdMaxIsa = isa;
+	}
+
+	const char* simdGetIsaName(SimdIsa isa)
+	{
+		switch (isa)
+		{
+		case SimdIsa_AVX2: return "AVX2";
+		case SimdIsa_AVX512: return "AVX-512";
+		default: return "Scalar";
+		}
+	}
+
+	u32 simdGetLaneCount(SimdIsa isa)
+	{
+		switch (isa)
+		{
+		case SimdIsa_AVX2: return 8;
+		case SimdIsa_AVX512: return 16;
+		default: return 1;
+		}
+	}
+}
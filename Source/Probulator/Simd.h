@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Common.h"
+
+namespace Probulator
+{
+	// Instruction sets that have dedicated kernel implementations, from narrowest to widest
+	enum SimdIsa
+	{
+		SimdIsa_Scalar,
+		SimdIsa_AVX2, // 8 float lanes, requires FMA
+		SimdIsa_AVX512, // 16 float lanes
+	};
+
+	// Widest instruction set supported by both the CPU and this build, limited by simdSetMaxIsa
+	SimdIsa simdGetIsa();
+
+	// Widest instruction set supported by both the CPU and this build
+	SimdIsa simdGetSupportedIsa();
+
+	// Limits instruction set used by kernels, which is useful to compare implementations
+	void simdSetMaxIsa(SimdIsa isa);
+
+	const char* simdGetIsaName(SimdIsa isa);
+	u32 simdGetLaneCount(SimdIsa isa);
+}
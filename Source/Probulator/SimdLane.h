@@ -0,0 +1,130 @@
+#pragma once
+
+// Thin wrappers over SIMD registers with a common interface, so kernels can be written once
+// as templates over the lane type and instantiated per instruction set.
+// AVX2 and AVX-512 lanes are only available in translation units compiled for those instruction sets.
+// Everything lives in an anonymous namespace, since the same inline functions compiled with
+// different target flags must not be merged by the linker.
+
+#include "Common.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace Probulator
+{
+namespace
+{
+	struct ScalarLane
+	{
+		static const u32 Width = 1;
+
+		float v;
+
+		ScalarLane() {}
+		ScalarLane(float x) : v(x) {}
+
+		static ScalarLane load(const float* p) { return ScalarLane(*p); }
+		void store(float* p) const { *p = v; }
+
+		friend ScalarLane operator+(ScalarLane a, ScalarLane b) { return ScalarLane(a.v + b.v); }
+		friend ScalarLane operator-(ScalarLane a, ScalarLane b) { return ScalarLane(a.v - b.v); }
+		friend ScalarLane operator*(ScalarLane a, ScalarLane b) { return ScalarLane(a.v * b.v); }
+		friend ScalarLane operator/(ScalarLane a, ScalarLane b) { return ScalarLane(a.v / b.v); }
+		friend ScalarLane operator-(ScalarLane a) { return ScalarLane(-a.v); }
+		friend ScalarLane max(ScalarLane a, ScalarLane b) { return ScalarLane(a.v > b.v ? a.v : b.v); }
+		friend ScalarLane min(ScalarLane a, ScalarLane b) { return ScalarLane(a.v < b.v ? a.v : b.v); }
+		// Only valid in the range of s32, avoids a library call on targets without a rounding instruction
+		friend ScalarLane floor(ScalarLane a) { float t = float(s32(a.v)); return ScalarLane(t > a.v ? t - 1.0f : t); }
+
+		// 2^n for integral n in [-127, 127], 0 for n = -127
+		friend ScalarLane exp2Integral(ScalarLane n)
+		{
+			u32 bits = u32(s32(n.v) + 127) << 23;
+			float result;
+			memcpy(&result, &bits, sizeof(result));
+			return ScalarLane(result);
+		}
+	};
+
+#if defined(__AVX2__)
+	struct Avx2Lane
+	{
+		static const u32 Width = 8;
+
+		__m256 v;
+
+		Avx2Lane() {}
+		Avx2Lane(__m256 x) : v(x) {}
+		Avx2Lane(float x) : v(_mm256_set1_ps(x)) {}
+
+		static Avx2Lane load(const float* p) { return Avx2Lane(_mm256_loadu_ps(p)); }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+		friend Avx2Lane operator+(Avx2Lane a, Avx2Lane b) { return Avx2Lane(_mm256_add_ps(a.v, b.v)); }
+		friend Avx2Lane operator-(Avx2Lane a, Avx2Lane b) { return Avx2Lane(_mm256_sub_ps(a.v, b.v)); }
+		friend Avx2Lane operator*(Avx2Lane a, Avx2Lane b) { return Avx2Lane(_mm256_mul_ps(a.v, b.v)); }
+		friend Avx2Lane operator/(Avx2Lane a, Avx2Lane b) { return Avx2Lane(_mm256_div_ps(a.v, b.v)); }
+		friend Avx2Lane operator-(Avx2Lane a) { return Avx2Lane(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))); }
+		friend Avx2Lane max(Avx2Lane a, Avx2Lane b) { return Avx2Lane(_mm256_max_ps(a.v, b.v)); }
+		friend Avx2Lane min(Avx2Lane a, Avx2Lane b) { return Avx2Lane(_mm256_min_ps(a.v, b.v)); }
+		friend Avx2Lane floor(Avx2Lane a) { return Avx2Lane(_mm256_floor_ps(a.v)); }
+		friend Avx2Lane exp2Integral(Avx2Lane n) { return Avx2Lane(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127)), 23))); }
+	};
+#endif
+
+#if defined(__AVX512F__)
+	struct Avx512Lane
+	{
+		static const u32 Width = 16;
+
+		__m512 v;
+
+		Avx512Lane() {}
+		Avx512Lane(__m512 x) : v(x) {}
+		Avx512Lane(float x) : v(_mm512_set1_ps(x)) {}
+
+		static Avx512Lane load(const float* p) { return Avx512Lane(_mm512_loadu_ps(p)); }
+		void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+		friend Avx512Lane operator+(Avx512Lane a, Avx512Lane b) { return Avx512Lane(_mm512_add_ps(a.v, b.v)); }
+		friend Avx512Lane operator-(Avx512Lane a, Avx512Lane b) { return Avx512Lane(_mm512_sub_ps(a.v, b.v)); }
+		friend Avx512Lane operator*(Avx512Lane a, Avx512Lane b) { return Avx512Lane(_mm512_mul_ps(a.v, b.v)); }
+		friend Avx512Lane operator/(Avx512Lane a, Avx512Lane b) { return Avx512Lane(_mm512_div_ps(a.v, b.v)); }
+		friend Avx512Lane operator-(Avx512Lane a) { return Avx512Lane(_mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(int(0x80000000))))); }
+		friend Avx512Lane max(Avx512Lane a, Avx512Lane b) { return Avx512Lane(_mm512_max_ps(a.v, b.v)); }
+		friend Avx512Lane min(Avx512Lane a, Avx512Lane b) { return Avx512Lane(_mm512_min_ps(a.v, b.v)); }
+		friend Avx512Lane floor(Avx512Lane a) { return Avx512Lane(_mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)); }
+		friend Avx512Lane exp2Integral(Avx512Lane n) { return Avx512Lane(_mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(n.v), _mm512_set1_epi32(127)), 23))); }
+	};
+#endif
+
+	// Polynomial exp approximation (Cephes expf): the argument is reduced to r in [-ln(2)/2, ln(2)/2] with
+	// x = n * ln(2) + r, and exp(r) is approximated with a degree 7 polynomial.
+	// Maximum relative error is 8.5e-8 (below 1 ulp) for x in [-87.3, 88], measured against double precision exp
+	// for every float in the range, with and without fused multiply-add.
+	// Smaller x return 0 or denormals (the exact result is below FLT_MIN), larger x are clamped. NaN is not supported.
+	template <typename Lane>
+	inline Lane expFast(Lane x)
+	{
+		x = max(min(x, Lane(88.0f)), Lane(-88.0f));
+
+		const Lane n = floor(x * Lane(1.44269504088896341f) + Lane(0.5f));
+		const Lane r = (x - n * Lane(0.693359375f)) - n * Lane(-2.12194440e-4f);
+
+		Lane p = Lane(1.9875691500e-4f);
+		p = p * r + Lane(1.3981999507e-3f);
+		p = p * r + Lane(8.3334519073e-3f);
+		p = p * r + Lane(4.1665795894e-2f);
+		p = p * r + Lane(1.6666665459e-1f);
+		p = p * r + Lane(5.0000001201e-1f);
+		p = p * r * r + r + Lane(1.0f);
+
+		return p * exp2Integral(n);
+	}
+}
+}
@@ -1,7 +1,102 @@
 #include "SphericalGaussian.h"
+#include "SphericalGaussianKernel.h"
+#include "Simd.h"
+
+#include <atomic>
 
 namespace Probulator
 {
+	static std::atomic<int> g_sgPrecision(SgPrecision_Fast);
+
+	SgPrecision sgGetPrecision()
+	{
+		return (SgPrecision)g_sgPrecision.load(std::memory_order_relaxed);
+	}
+
+	void sgSetPrecision(SgPrecision precision)
+	{
+		g_sgPrecision = precision;
+	}
+
+	static void sgEvaluateBatchExact(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+		{
+			const SphericalGaussian& lobe = lobes[lobeIt];
+			float* plane = out + lobeIt * planeStride;
+			for (u32 i = 0; i < count; ++i)
+			{
+				float dp = x[i] * lobe.p.x + y[i] * lobe.p.y + z[i] * lobe.p.z;
+				plane[i] = exp(lobe.lambda * (dp - 1.0f));
+			}
+		}
+	}
+
+	static void sgEvaluateSumBatchExact(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB)
+	{
+		for (u32 i = 0; i < count; ++i)
+		{
+			vec3 result = vec3(0.0f);
+			for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+			{
+				const SphericalGaussian& lobe = lobes[lobeIt];
+				float dp = x[i] * lobe.p.x + y[i] * lobe.p.y + z[i] * lobe.p.z;
+				result += lobe.mu * exp(lobe.lambda * (dp - 1.0f));
+			}
+			outR[i] = result.r;
+			outG[i] = result.g;
+			outB[i] = result.b;
+		}
+	}
+
+	// The polynomial exp approximation is only used where it is vectorized, one lane at a time it is not faster than the C library
+
+	void sgEvaluateBatch(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+#if PROBULATOR_SIMD_X86
+		if (sgGetPrecision() == SgPrecision_Fast)
+		{
+			switch (simdGetIsa())
+			{
+			case SimdIsa_AVX512:
+				sgEvaluateBatchAVX512(lobes, lobeCount, x, y, z, count, out, planeStride);
+				return;
+			case SimdIsa_AVX2:
+				sgEvaluateBatchAVX2(lobes, lobeCount, x, y, z, count, out, planeStride);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		sgEvaluateBatchExact(lobes, lobeCount, x, y, z, count, out, planeStride);
+	}
+
+	void sgEvaluateSumBatch(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB)
+	{
+#if PROBULATOR_SIMD_X86
+		if (sgGetPrecision() == SgPrecision_Fast)
+		{
+			switch (simdGetIsa())
+			{
+			case SimdIsa_AVX512:
+				sgEvaluateSumBatchAVX512(lobes, lobeCount, x, y, z, count, outR, outG, outB);
+				return;
+			case SimdIsa_AVX2:
+				sgEvaluateSumBatchAVX2(lobes, lobeCount, x, y, z, count, outR, outG, outB);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		sgEvaluateSumBatchExact(lobes, lobeCount, x, y, z, count, outR, outG, outB);
+	}
+
 	float sgIntegral(float lambda)
 	{
 		return fourPi * (0.5f - 0.5f*exp(-2.0f*lambda)) / lambda;
@@ -9,10 +104,11 @@ namespace Probulator
 
 	vec3 sgDot(const SphericalGaussian& a, const SphericalGaussian& b)
 	{
+		// sinh(dM) / exp(lambdaA + lambdaB) is expanded, so that sharp lobes do not overflow the exponent
 		float dM = length(a.lambda*a.p + b.lambda*b.p);
-		vec3 num = sinh(dM) * fourPi * a.mu * b.mu;
-		float den = exp(a.lambda + b.lambda) * dM;
-		return num / den;
+		float lambdaSum = a.lambda + b.lambda;
+		float sinhRatio = 0.5f * (exp(dM - lambdaSum) - exp(-dM - lambdaSum));
+		return sinhRatio * fourPi * a.mu * b.mu / dM;
 	}
 
 	float sgEvaluate(const vec3& p, float lambda, const vec3& v)
@@ -54,10 +150,25 @@ namespace Probulator
     // Stephen Hill [2016], https://mynameismjp.wordpress.com/2016/10/09/sg-series-part-3-diffuse-lighting-from-an-sg-light-source/
     vec3 sgIrradianceFitted(const SphericalGaussian& lightingLobe, const vec3& normal)
     {
+        return sgIrradianceFitted(sgIrradianceFittedPrepare(lightingLobe), normal);
+    }
+
+    SgIrradianceFittedLobe sgIrradianceFittedPrepare(const SphericalGaussian& lightingLobe)
+    {
+        SgIrradianceFittedLobe result;
+        result.p = lightingLobe.p;
+
+        // Constant irradiance for lobes that cover the entire sphere
         if(lightingLobe.lambda == 0.f)
-            return lightingLobe.mu;
-        
-        const float muDotN = dot(lightingLobe.p, normal);
+        {
+            result.mu = lightingLobe.mu;
+            result.scale = 0.0f;
+            result.bias = 1.0f;
+            result.x = 1.0f;
+            result.x1 = 0.0f;
+            return result;
+        }
+
         const float lambda = lightingLobe.lambda;
         
         const float c0 = 0.36f;
@@ -67,21 +178,31 @@ namespace Probulator
         float em2l = eml * eml;
         float rl   = 1.f / lambda;
         
-        float scale = 1.0f + 2.0f * em2l - rl;
-        float bias  = (eml - em2l) * rl - em2l;
+        result.scale = 1.0f + 2.0f * em2l - rl;
+        result.bias  = (eml - em2l) * rl - em2l;
         
-        float x  = sqrt(1.0f - scale);
-        float x0 = c0 * muDotN;
-        float x1 = c1 * x;
+        result.x  = sqrt(1.0f - result.scale);
+        result.x1 = c1 * result.x;
+
+        result.mu = lightingLobe.mu * sgIntegral(lightingLobe.lambda);
+        return result;
+    }
+
+    vec3 sgIrradianceFitted(const SgIrradianceFittedLobe& lightingLobe, const vec3& normal)
+    {
+        const float muDotN = dot(lightingLobe.p, normal);
+
+        const float c0 = 0.36f;
         
-        float n = x0 + x1;
+        float x0 = c0 * muDotN;
+        float n = x0 + lightingLobe.x1;
         
         float y = saturate(muDotN);
-        if(abs(x0) <= x1)
-            y = n * n / x;
+        if(abs(x0) <= lightingLobe.x1)
+            y = n * n / lightingLobe.x;
         
-        float result = scale * y + bias;
+        float result = lightingLobe.scale * y + lightingLobe.bias;
         
-        return result * lightingLobe.mu * sgIntegral(lightingLobe.lambda);
+        return result * lightingLobe.mu;
     }
 }
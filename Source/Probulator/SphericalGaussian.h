@@ -23,6 +23,30 @@ namespace Probulator
 	float sgEvaluate(const vec3& p, float lambda, const vec3& v);
 	vec3 sgEvaluate(const SphericalGaussian& sg, const vec3& v);
 
+	enum SgPrecision
+	{
+		SgPrecision_Fast, // vectorized exp approximation (see expFast in SimdLane.h), falls back to std::exp without AVX2
+		SgPrecision_Exact, // scalar std::exp, matches sgEvaluate
+	};
+
+	// Precision of batched SG evaluation, fast by default. Fast weights differ from sgEvaluate mostly because the exponent
+	// is computed with fused multiply-add, and the rounding error of lambda * (dot(p, v) - 1) grows linearly with sharpness.
+	// Maximum relative error is about 1.2e-7 * lambda: 1e-6 for sharpness 6, 1.5e-5 for 100 and 1.2e-4 for 1000
+	// (see ProbulatorBench --kernels). Fits can produce sharp lobes (L-BFGS lobes exceed 300), so use the exact mode
+	// (ProbulatorCLI --exact-exp) for reference results and to measure the effect of the approximation.
+	SgPrecision sgGetPrecision();
+	void sgSetPrecision(SgPrecision precision);
+
+	// Evaluates lobe weights exp(lambda * (dot(p, v) - 1)) of lobeCount lobes for count directions
+	// given as separate x, y and z arrays. Weight of lobe i for direction j is written to out[i * planeStride + j].
+	// Uses the widest SIMD instruction set supported at runtime, unless the precision is SgPrecision_Exact.
+	void sgEvaluateBatch(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride);
+
+	// Evaluates the sum of lobes (including amplitude) for count directions, one output array per color channel
+	void sgEvaluateSumBatch(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB);
+
 	// Calculates spherical integral for SG with mu=1.0 and given lambda
 	float sgIntegral(float lambda);
 
@@ -46,4 +70,19 @@ namespace Probulator
 
     // Approximate SG irradiance using a curve fit.
     vec3 sgIrradianceFitted(const SphericalGaussian& lightingLobe, const vec3& normal);
+
+    // Terms of the irradiance curve fit that only depend on the lighting lobe,
+    // for evaluating the same lobe for many normals
+    struct SgIrradianceFittedLobe
+    {
+        vec3 p;
+        vec3 mu; // includes the lobe integral
+        float scale;
+        float bias;
+        float x;
+        float x1;
+    };
+
+    SgIrradianceFittedLobe sgIrradianceFittedPrepare(const SphericalGaussian& lightingLobe);
+    vec3 sgIrradianceFitted(const SgIrradianceFittedLobe& lightingLobe, const vec3& normal);
 }
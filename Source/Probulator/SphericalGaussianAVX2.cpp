@@ -0,0 +1,18 @@
+// Compiled with AVX2 and FMA code generation enabled (see CMakeLists.txt)
+
+#include "SphericalGaussianKernel.h"
+
+namespace Probulator
+{
+	void sgEvaluateBatchAVX2(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		sgEvaluateBatchKernel<Avx2Lane>(lobes, lobeCount, x, y, z, count, out, planeStride);
+	}
+
+	void sgEvaluateSumBatchAVX2(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB)
+	{
+		sgEvaluateSumBatchKernel<Avx2Lane>(lobes, lobeCount, x, y, z, count, outR, outG, outB);
+	}
+}
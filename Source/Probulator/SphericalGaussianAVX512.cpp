@@ -0,0 +1,18 @@
+// Compiled with AVX-512 code generation enabled (see CMakeLists.txt)
+
+#include "SphericalGaussianKernel.h"
+
+namespace Probulator
+{
+	void sgEvaluateBatchAVX512(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		sgEvaluateBatchKernel<Avx512Lane>(lobes, lobeCount, x, y, z, count, out, planeStride);
+	}
+
+	void sgEvaluateSumBatchAVX512(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB)
+	{
+		sgEvaluateSumBatchKernel<Avx512Lane>(lobes, lobeCount, x, y, z, count, outR, outG, outB);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// Batched SG evaluation kernels shared by per-instruction-set translation units.
+// Use sgEvaluateBatch and sgEvaluateSumBatch from SphericalGaussian.h instead of including this directly.
+
+#include "SphericalGaussian.h"
+#include "SimdLane.h"
+
+namespace Probulator
+{
+	// Implemented in translation units compiled for the corresponding instruction set
+	void sgEvaluateBatchAVX2(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride);
+	void sgEvaluateBatchAVX512(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride);
+	void sgEvaluateSumBatchAVX2(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB);
+	void sgEvaluateSumBatchAVX512(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB);
+
+namespace
+{
+	template <typename Lane>
+	inline Lane sgEvaluateLanes(const SphericalGaussian& lobe, Lane x, Lane y, Lane z)
+	{
+		const Lane dp = x * Lane(lobe.p.x) + y * Lane(lobe.p.y) + z * Lane(lobe.p.z);
+		return expFast(Lane(lobe.lambda) * (dp - Lane(1.0f)));
+	}
+
+	// Directions of a lane group stay in registers while all lobes are visited
+	template <typename Lane>
+	inline void sgEvaluateLaneGroup(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, float* out, size_t planeStride)
+	{
+		const Lane dx = Lane::load(x);
+		const Lane dy = Lane::load(y);
+		const Lane dz = Lane::load(z);
+		for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+		{
+			sgEvaluateLanes(lobes[lobeIt], dx, dy, dz).store(out + lobeIt * planeStride);
+		}
+	}
+
+	template <typename Lane>
+	inline void sgEvaluateSumLaneGroup(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, float* outR, float* outG, float* outB)
+	{
+		const Lane dx = Lane::load(x);
+		const Lane dy = Lane::load(y);
+		const Lane dz = Lane::load(z);
+		Lane r(0.0f), g(0.0f), b(0.0f);
+		for (u32 lobeIt = 0; lobeIt < lobeCount; ++lobeIt)
+		{
+			const SphericalGaussian& lobe = lobes[lobeIt];
+			const Lane w = sgEvaluateLanes(lobe, dx, dy, dz);
+			r = r + Lane(lobe.mu.r) * w;
+			g = g + Lane(lobe.mu.g) * w;
+			b = b + Lane(lobe.mu.b) * w;
+		}
+		r.store(outR);
+		g.store(outG);
+		b.store(outB);
+	}
+
+	// Full-width lanes over the bulk of the batch, scalar lanes for the remainder
+	template <typename Lane>
+	inline void sgEvaluateBatchKernel(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		u32 i = 0;
+		for (; i + Lane::Width <= count; i += Lane::Width)
+		{
+			sgEvaluateLaneGroup<Lane>(lobes, lobeCount, x + i, y + i, z + i, out + i, planeStride);
+		}
+		for (; i < count; ++i)
+		{
+			sgEvaluateLaneGroup<ScalarLane>(lobes, lobeCount, x + i, y + i, z + i, out + i, planeStride);
+		}
+	}
+
+	template <typename Lane>
+	inline void sgEvaluateSumBatchKernel(const SphericalGaussian* lobes, u32 lobeCount,
+		const float* x, const float* y, const float* z, u32 count, float* outR, float* outG, float* outB)
+	{
+		u32 i = 0;
+		for (; i + Lane::Width <= count; i += Lane::Width)
+		{
+			sgEvaluateSumLaneGroup<Lane>(lobes, lobeCount, x + i, y + i, z + i, outR + i, outG + i, outB + i);
+		}
+		for (; i < count; ++i)
+		{
+			sgEvaluateSumLaneGroup<ScalarLane>(lobes, lobeCount, x + i, y + i, z + i, outR + i, outG + i, outB + i);
+		}
+	}
+}
+}
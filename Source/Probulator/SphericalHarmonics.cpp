@@ -0,0 +1,22 @@
+#include "SphericalHarmonics.h"
+#include "SphericalHarmonicsKernel.h"
+#include "Simd.h"
+
+namespace Probulator
+{
+	void shEvaluateBatch(size_t L, const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+#if PROBULATOR_SIMD_X86
+		switch (simdGetIsa())
+		{
+		case SimdIsa_AVX512:
+		case SimdIsa_AVX2:
+			shEvaluateBatchAVX2(L, x, y, z, count, out, planeStride);
+			return;
+		default:
+			break;
+		}
+#endif
+		shEvaluateBatchKernel<ScalarLane>(L, x, y, z, count, out, planeStride);
+	}
+}
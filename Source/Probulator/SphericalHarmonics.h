@@ -1,6 +1,10 @@
 #pragma once
 
 #include "Math.h"
+#include "RadianceSample.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace Probulator
 {
@@ -123,6 +127,53 @@ namespace Probulator
 		return result;
 	}
 
+	// Evaluates SH basis functions for count directions given as separate x, y and z arrays.
+	// Coefficient i of direction j is written to out[i * planeStride + j].
+	// Uses AVX2 when supported at runtime, results match shEvaluate<L> up to rounding.
+	void shEvaluateBatch(size_t L, const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride);
+
+	template <size_t L>
+	inline void shEvaluateBatch(const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		static_assert(L<=4, "Spherical Harmonics above L4 are not supported");
+		shEvaluateBatch(L, x, y, z, count, out, planeStride);
+	}
+
+	// SH basis functions evaluated for a batch of directions, stored as one plane per coefficient
+	template <size_t L>
+	class ShBatch
+	{
+	public:
+
+		void evaluate(const float* x, const float* y, const float* z, u32 count)
+		{
+			m_count = count;
+			m_planes.resize(shSize(L) * count);
+			shEvaluateBatch<L>(x, y, z, count, m_planes.data(), count);
+		}
+
+		u32 size() const { return m_count; }
+
+		const float* getPlane(size_t coefficient) const { return &m_planes[coefficient * m_count]; }
+
+		// Same as shDot(sh, shEvaluate<L>(direction)) for the given direction of the batch
+		template <typename T>
+		T dot(const SphericalHarmonicsT<T, L>& sh, u32 index) const
+		{
+			T result = T(0);
+			for (size_t i = 0; i < shSize(L); ++i)
+			{
+				result += sh[i] * m_planes[i * m_count + index];
+			}
+			return result;
+		}
+
+	private:
+
+		std::vector<float> m_planes;
+		u32 m_count = 0;
+	};
+
 	inline SphericalHarmonicsL1 shEvaluateL1(vec3 p)
 	{
 		return shEvaluate<1>(p);
@@ -351,16 +402,28 @@ namespace Probulator
 	}
 
 	template <typename T, size_t L>
-	inline T shMeanSquareError(const SphericalHarmonicsT<T, L>& sh, const std::vector<RadianceSample>& radianceSamples)
+	inline T shMeanSquareError(const SphericalHarmonicsT<T, L>& sh, const RadianceSampleArray& radianceSamples)
 	{
+		const u32 BlockSize = 256;
+
 		T errorSquaredSum = T(0.0f);
+		ShBatch<L> basis;
 
-		for (const RadianceSample& sample : radianceSamples)
+		for (u32 blockBegin = 0; blockBegin < radianceSamples.size(); blockBegin += BlockSize)
 		{
-			auto directionSh = shEvaluate<L>(sample.direction);
-			auto reconstructedValue = shDot(sh, directionSh);
-			auto error = sample.value - reconstructedValue;
-			errorSquaredSum += error*error;
+			const u32 blockSize = std::min(BlockSize, radianceSamples.size() - blockBegin);
+			basis.evaluate(
+				&radianceSamples.directionX[blockBegin],
+				&radianceSamples.directionY[blockBegin],
+				&radianceSamples.directionZ[blockBegin],
+				blockSize);
+
+			for (u32 i = 0; i < blockSize; ++i)
+			{
+				auto reconstructedValue = basis.dot(sh, i);
+				auto error = radianceSamples.getValue(blockBegin + i) - reconstructedValue;
+				errorSquaredSum += error*error;
+			}
 		}
 
 		float sampleWeight = 1.0f / radianceSamples.size();
@@ -368,7 +431,7 @@ namespace Probulator
 	}
 
 	template <typename T, size_t L>
-	inline float shMeanSquareErrorScalar(const SphericalHarmonicsT<T, L>& sh, const std::vector<RadianceSample>& radianceSamples)
+	inline float shMeanSquareErrorScalar(const SphericalHarmonicsT<T, L>& sh, const RadianceSampleArray& radianceSamples)
 	{
 		return dot(shMeanSquareError(sh, radianceSamples), T(1.0f / 3.0f));
 	}
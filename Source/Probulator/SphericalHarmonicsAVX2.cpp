@@ -0,0 +1,11 @@
+// Compiled with AVX2 and FMA code generation enabled (see CMakeLists.txt)
+
+#include "SphericalHarmonicsKernel.h"
+
+namespace Probulator
+{
+	void shEvaluateBatchAVX2(size_t L, const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		shEvaluateBatchKernel<Avx2Lane>(L, x, y, z, count, out, planeStride);
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+// Batched SH evaluation kernel shared by per-instruction-set translation units.
+// Use shEvaluateBatch from SphericalHarmonics.h instead of including this directly.
+
+#include "Math.h"
+#include "SimdLane.h"
+
+namespace Probulator
+{
+	// Implemented in a translation unit compiled for AVX2.
+	// There is no AVX-512 version, as it measured 1.2-1.8x slower than AVX2 (see ProbulatorBench --kernels).
+	void shEvaluateBatchAVX2(size_t L, const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride);
+
+namespace
+{
+	// Normalization factors of shEvaluate<L>, computed with the same expressions
+	struct ShEvaluateConstants
+	{
+		ShEvaluateConstants()
+		{
+			const float sqrtPi = sqrt(pi);
+
+			band0 = 1.0f / (2.0f*sqrtPi);
+
+			band1 = sqrt(3.0f/(4.0f*pi));
+
+			band2[0] = sqrt(15.0f/(4.0f*pi));
+			band2[1] = sqrt(5.0f/(16.0f*pi));
+			band2[2] = sqrt(15.0f/(16.0f*pi));
+
+			band3[0] = sqrt( 70.0f/(64.0f*pi));
+			band3[1] = sqrt(105.0f/ (4.0f*pi));
+			band3[2] = sqrt( 21.0f/(32.0f*pi));
+			band3[3] = sqrt(  7.0f/(16.0f*pi));
+			band3[4] = sqrt(105.0f/(16.0f*pi));
+
+			band4[0] = 3.0f*sqrt(35.0f/(16.0f*pi));
+			band4[1] = 3.0f*sqrt(70.0f/(64.0f*pi));
+			band4[2] = 3.0f*sqrt( 5.0f/(16.0f*pi));
+			band4[3] = 3.0f*sqrt(10.0f/(64.0f*pi));
+			band4[4] = 16.0f*sqrtPi;
+			band4[5] = 3.0f*sqrt( 5.0f/(64.0f*pi));
+			band4[6] = 3.0f*sqrt(35.0f/(4.0f*(64.0f*pi)));
+		}
+
+		float band0;
+		float band1;
+		float band2[3];
+		float band3[5];
+		float band4[7];
+	};
+
+	inline const ShEvaluateConstants& shGetEvaluateConstants()
+	{
+		static const ShEvaluateConstants constants;
+		return constants;
+	}
+
+	// Evaluates SH basis for Lane::Width directions and writes coefficient i to out[i * planeStride]
+	template <size_t L, typename Lane>
+	inline void shEvaluateLanes(const float* px, const float* py, const float* pz, float* out, size_t planeStride, const ShEvaluateConstants& k)
+	{
+		static_assert(L<=4, "Spherical Harmonics above L4 are not supported");
+
+		typedef Lane V;
+
+		const V x = -V::load(px);
+		const V y = -V::load(py);
+		const V z = V::load(pz);
+
+		const V x2 = x*x;
+		const V y2 = y*y;
+		const V z2 = z*z;
+
+		const V z3 = z2*z;
+
+		const V x4 = x2*x2;
+		const V y4 = y2*y2;
+		const V z4 = z2*z2;
+
+		size_t i = 0;
+
+		V(k.band0).store(out + planeStride * i++);
+
+		if (L >= 1)
+		{
+			(V(-k.band1)*y).store(out + planeStride * i++);
+			(V( k.band1)*z).store(out + planeStride * i++);
+			(V(-k.band1)*x).store(out + planeStride * i++);
+		}
+
+		if (L >= 2)
+		{
+			(V( k.band2[0])*y*x).store(out + planeStride * i++);
+			(V(-k.band2[0])*y*z).store(out + planeStride * i++);
+			(V( k.band2[1])*(V(3.0f)*z2-V(1.0f))).store(out + planeStride * i++);
+			(V(-k.band2[0])*x*z).store(out + planeStride * i++);
+			(V( k.band2[2])*(x2-y2)).store(out + planeStride * i++);
+		}
+
+		if (L >= 3)
+		{
+			(V(-k.band3[0])*y*(V(3.0f)*x2-y2)).store(out + planeStride * i++);
+			(V( k.band3[1])*y*x*z).store(out + planeStride * i++);
+			(V(-k.band3[2])*y*(V(-1.0f)+V(5.0f)*z2)).store(out + planeStride * i++);
+			(V( k.band3[3])*(V(5.0f)*z3-V(3.0f)*z)).store(out + planeStride * i++);
+			(V(-k.band3[2])*x*(V(-1.0f)+V(5.0f)*z2)).store(out + planeStride * i++);
+			(V( k.band3[4])*(x2-y2)*z).store(out + planeStride * i++);
+			(V(-k.band3[0])*x*(x2-V(3.0f)*y2)).store(out + planeStride * i++);
+		}
+
+		if (L >= 4)
+		{
+			(V( k.band4[0])*x*y*(x2-y2)).store(out + planeStride * i++);
+			(V(-k.band4[1])*y*z*(V(3.0f)*x2-y2)).store(out + planeStride * i++);
+			(V( k.band4[2])*y*x*(V(-1.0f)+V(7.0f)*z2)).store(out + planeStride * i++);
+			(V(-k.band4[3])*y*z*(V(-3.0f)+V(7.0f)*z2)).store(out + planeStride * i++);
+			((V(105.0f)*z4-V(90.0f)*z2+V(9.0f))/V(k.band4[4])).store(out + planeStride * i++);
+			(V(-k.band4[3])*x*z*(V(-3.0f)+V(7.0f)*z2)).store(out + planeStride * i++);
+			(V( k.band4[5])*(x2-y2)*(V(-1.0f)+V(7.0f)*z2)).store(out + planeStride * i++);
+			(V(-k.band4[1])*x*z*(x2-V(3.0f)*y2)).store(out + planeStride * i++);
+			(V( k.band4[6])*(x4-V(6.0f)*y2*x2+y4)).store(out + planeStride * i++);
+		}
+	}
+
+	// Full-width lanes over the bulk of the batch, scalar lanes for the remainder
+	template <size_t L, typename Lane>
+	inline void shEvaluateBatchKernel(const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		const ShEvaluateConstants& k = shGetEvaluateConstants();
+
+		u32 i = 0;
+		for (; i + Lane::Width <= count; i += Lane::Width)
+		{
+			shEvaluateLanes<L, Lane>(x + i, y + i, z + i, out + i, planeStride, k);
+		}
+		for (; i < count; ++i)
+		{
+			shEvaluateLanes<L, ScalarLane>(x + i, y + i, z + i, out + i, planeStride, k);
+		}
+	}
+
+	template <typename Lane>
+	inline void shEvaluateBatchKernel(size_t L, const float* x, const float* y, const float* z, u32 count, float* out, size_t planeStride)
+	{
+		switch (L)
+		{
+		case 0: shEvaluateBatchKernel<0, Lane>(x, y, z, count, out, planeStride); break;
+		case 1: shEvaluateBatchKernel<1, Lane>(x, y, z, count, out, planeStride); break;
+		case 2: shEvaluateBatchKernel<2, Lane>(x, y, z, count, out, planeStride); break;
+		case 3: shEvaluateBatchKernel<3, Lane>(x, y, z, count, out, planeStride); break;
+		case 4: shEvaluateBatchKernel<4, Lane>(x, y, z, count, out, planeStride); break;
+		default: assert(!"Spherical Harmonics above L4 are not supported");
+		}
+	}
+}
+}
@@ -1,16 +1,112 @@
 #include "Thread.h"
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace Probulator
 {
 	enki::TaskScheduler g_TS;
 
-	struct TaskSchedulerInitializer
+	static std::atomic<bool> g_taskSchedulerInitialized(false);
+	static std::mutex g_taskSchedulerMutex;
+	static std::vector<u32> g_threadCpus; // CPU index for each task thread, empty when threads are not pinned
+
+	static bool setCurrentThreadAffinity(u32 cpu)
+	{
+#if defined(_WIN32)
+		return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(cpu, &cpuSet);
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+		(void)cpu;
+		return false; // Thread affinity is not supported on this platform
+#endif
+	}
+
+	static void pinTaskThread(u32 threadNum)
 	{
-		TaskSchedulerInitializer()
+		if (!g_threadCpus.empty())
 		{
-			g_TS.Initialize();
+			setCurrentThreadAffinity(g_threadCpus[threadNum % g_threadCpus.size()]);
 		}
-	};
-	
-	static TaskSchedulerInitializer taskSchedulerInitializer;
-}
\ No newline at end of file
+	}
+
+	static void taskSchedulerInitializeLocked(u32 threadCount, u64 affinityMask)
+	{
+		g_threadCpus.clear();
+		for (u32 cpu = 0; cpu < 64; ++cpu)
+		{
+			if (affinityMask & (u64(1) << cpu))
+			{
+				g_threadCpus.push_back(cpu);
+			}
+		}
+
+		if (threadCount == 0)
+		{
+			threadCount = g_threadCpus.empty() ? enki::GetNumHardwareThreads() : (u32)g_threadCpus.size();
+			threadCount = threadCount ? threadCount : 1;
+		}
+
+		// Worker threads pin themselves on startup, main thread (task thread 0) is pinned here
+		g_TS.GetProfilerCallbacks()->threadStart = pinTaskThread;
+		g_TS.Initialize(threadCount);
+		pinTaskThread(0);
+
+		g_taskSchedulerInitialized = true;
+	}
+
+	void taskSchedulerInitialize(u32 threadCount, u64 affinityMask)
+	{
+		std::lock_guard<std::mutex> lock(g_taskSchedulerMutex);
+		if (g_taskSchedulerInitialized)
+		{
+			g_TS.WaitforAll();
+		}
+		taskSchedulerInitializeLocked(threadCount, affinityMask);
+	}
+
+	void taskSchedulerShutdown()
+	{
+		std::lock_guard<std::mutex> lock(g_taskSchedulerMutex);
+		if (g_taskSchedulerInitialized)
+		{
+			g_TS.WaitforAllAndShutdown();
+			g_taskSchedulerInitialized = false;
+		}
+	}
+
+	void taskSchedulerEnsureInitialized()
+	{
+		if (g_taskSchedulerInitialized.load(std::memory_order_acquire))
+			return;
+
+		std::lock_guard<std::mutex> lock(g_taskSchedulerMutex);
+		if (!g_taskSchedulerInitialized)
+		{
+			taskSchedulerInitializeLocked(0, 0);
+		}
+	}
+
+	u32 taskSchedulerGetThreadCount()
+	{
+		return g_taskSchedulerInitialized ? g_TS.GetNumTaskThreads() : 0;
+	}
+}
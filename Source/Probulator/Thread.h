@@ -1,31 +1,140 @@
 #pragma once
 
+#include "Common.h"
+#include "Memory.h"
+#include "Trace.h"
+
 #include <TaskScheduler.h>
 #include <thread>
+#include <vector>
 
 namespace Probulator
 {
 	extern enki::TaskScheduler g_TS;
 
-	template <typename I, typename F>
-	inline void parallelFor(I begin, I end, F fun)
+	// Starts task scheduler worker threads. Thread count of 0 uses all available hardware threads.
+	// If affinityMask is non-zero, task thread N is pinned to the N-th CPU set in the mask (wrapping around)
+	// and thread count defaults to the number of CPUs in the mask.
+	// Calling this again restarts the scheduler with new settings.
+	void taskSchedulerInitialize(u32 threadCount = 0, u64 affinityMask = 0);
+
+	// Waits for outstanding tasks and stops worker threads
+	void taskSchedulerShutdown();
+
+	// Initializes the scheduler with default settings unless it is already running.
+	// Parallel loops call this, so tools that don't care about threading don't need to do anything.
+	void taskSchedulerEnsureInitialized();
+
+	// Number of task threads including the calling thread, 0 if the scheduler is not running
+	u32 taskSchedulerGetThreadCount();
+
+	// Contiguous range of loop indices processed by a single worker
+	struct ParallelRange
 	{
+		u32 begin;
+		u32 end;
+		u32 threadIndex;
+	};
+
+	// Invoke fun(const ParallelRange& range) over [begin, end) split into ranges of at least grainSize indices
+	template <typename F>
+	inline void parallelForRange(u32 begin, u32 end, u32 grainSize, F fun)
+	{
+		if (end <= begin)
+			return;
+
 #if 1
+		PROBULATOR_TRACE_SCOPE("parallelFor");
+
+		taskSchedulerEnsureInitialized();
+
+#if PROBULATOR_MEMORY_TRACKING
+		const MemoryContext memoryContext = memoryGetContext();
+#endif
+
 		enki::TaskSet taskSet(end - begin,
-			[&](enki::TaskSetPartition range, I threadnum)
+			[&](enki::TaskSetPartition partition, u32 threadnum)
 		{
-			for(I i=range.start; i!=range.end; ++i)
-			{
-				fun(i);
-			}
+			PROBULATOR_TRACE_SCOPE("parallelFor range");
+			PROBULATOR_MEMORY_SCOPE(memoryContext); // allocations are charged to the caller
+			ParallelRange range = { begin + partition.start, begin + partition.end, threadnum };
+			fun(range);
 		});
+		taskSet.m_MinRange = grainSize ? grainSize : 1;
 		g_TS.AddTaskSetToPipe(&taskSet);
 		g_TS.WaitforTask(&taskSet);
 #else
-		for(I i=begin; i!=end; ++i)
+		ParallelRange range = { begin, end, 0 };
+		fun(range);
+#endif
+	}
+
+	// Invoke fun(Context& context, u32 i) over [begin, end) in parallel.
+	// Context is default-constructed once per scheduled range, which makes it suitable
+	// for worker scratch state (RNGs, temporary buffers, partial results).
+	template <typename Context, typename F>
+	inline void parallelForWithContext(u32 begin, u32 end, u32 grainSize, F fun)
+	{
+		parallelForRange(begin, end, grainSize, [&](const ParallelRange& range)
 		{
-			fun(i);
+			Context context;
+			for (u32 i = range.begin; i != range.end; ++i)
+			{
+				fun(context, i);
+			}
+		});
+	}
+
+	// Deterministic parallel reduction.
+	// [begin, end) is split into fixed chunks of grainSize indices, each accumulated serially with
+	// fun(T& accumulator, u32 i) starting from identity. Chunk results are merged pairwise with
+	// combine(const T& a, const T& b) in a fixed order, so the result is independent of thread count.
+	template <typename T, typename F, typename C>
+	inline T parallelReduce(u32 begin, u32 end, u32 grainSize, const T& identity, F fun, C combine)
+	{
+		if (end <= begin)
+			return identity;
+
+		grainSize = grainSize ? grainSize : 1;
+
+		const u32 chunkCount = (end - begin + grainSize - 1) / grainSize;
+		std::vector<T> partials(chunkCount, identity);
+
+		parallelForRange(0u, chunkCount, 1, [&](const ParallelRange& range)
+		{
+			for (u32 chunkIt = range.begin; chunkIt != range.end; ++chunkIt)
+			{
+				const u32 chunkBegin = begin + chunkIt * grainSize;
+				const u32 chunkEnd = (end - chunkBegin) > grainSize ? chunkBegin + grainSize : end;
+
+				T& accumulator = partials[chunkIt];
+				for (u32 i = chunkBegin; i != chunkEnd; ++i)
+				{
+					fun(accumulator, i);
+				}
+			}
+		});
+
+		for (u32 stride = 1; stride < chunkCount; stride *= 2)
+		{
+			for (u32 i = 0; i + stride < chunkCount; i += 2 * stride)
+			{
+				partials[i] = combine(partials[i], partials[i + stride]);
+			}
 		}
-#endif
+
+		return partials[0];
+	}
+
+	template <typename I, typename F>
+	inline void parallelFor(I begin, I end, F fun)
+	{
+		parallelForRange((u32)begin, (u32)end, 1, [&](const ParallelRange& range)
+		{
+			for (u32 i = range.begin; i != range.end; ++i)
+			{
+				fun((I)i);
+			}
+		});
 	}
 }
@@ -0,0 +1,191 @@
+#include "Trace.h"
+#include "Json.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace Probulator
+{
+	std::atomic<bool> g_traceEnabled(false);
+
+	namespace
+	{
+		struct TraceZone
+		{
+			const char* name;
+			u64 beginTime;
+			u64 endTime;
+		};
+
+		// Written only by the owning thread, so recording does not need synchronization
+		struct TraceThreadBuffer
+		{
+			static const u32 Capacity = 1 << 16; // power of two
+
+			std::vector<TraceZone> zones;
+			u64 writeCount = 0;
+			u32 threadId = 0;
+
+			u64 getZoneCount() const { return writeCount < Capacity ? writeCount : u64(Capacity); }
+			u64 getFirstZone() const { return writeCount - getZoneCount(); }
+			const TraceZone& getZone(u64 i) const { return zones[i & (Capacity - 1)]; }
+		};
+
+		std::mutex g_traceMutex;
+		std::vector<std::unique_ptr<TraceThreadBuffer>> g_traceBuffers; // never freed, threads may outlive the trace
+		std::set<std::string> g_traceNames;
+
+		thread_local TraceThreadBuffer* t_traceBuffer = nullptr;
+
+		TraceThreadBuffer* getThreadBuffer()
+		{
+			if (!t_traceBuffer)
+			{
+				std::lock_guard<std::mutex> lock(g_traceMutex);
+				g_traceBuffers.push_back(std::unique_ptr<TraceThreadBuffer>(new TraceThreadBuffer));
+				t_traceBuffer = g_traceBuffers.back().get();
+				t_traceBuffer->zones.resize(TraceThreadBuffer::Capacity);
+				t_traceBuffer->threadId = u32(g_traceBuffers.size() - 1);
+			}
+			return t_traceBuffer;
+		}
+
+		u64 getTraceBeginTime()
+		{
+			u64 result = ~0ull;
+			for (const auto& buffer : g_traceBuffers)
+			{
+				for (u64 i = buffer->getFirstZone(); i != buffer->writeCount; ++i)
+				{
+					result = std::min(result, buffer->getZone(i).beginTime);
+				}
+			}
+			return result;
+		}
+	}
+
+	void traceSetEnabled(bool state)
+	{
+		g_traceEnabled = state;
+	}
+
+	u64 traceGetTime()
+	{
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	void traceRecordZone(const char* name, u64 beginTime, u64 endTime)
+	{
+		TraceThreadBuffer* buffer = getThreadBuffer();
+		TraceZone& zone = buffer->zones[buffer->writeCount & (TraceThreadBuffer::Capacity - 1)];
+		zone.name = name;
+		zone.beginTime = beginTime;
+		zone.endTime = endTime;
+		buffer->writeCount++;
+	}
+
+	const char* traceInternName(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(g_traceMutex);
+		return g_traceNames.insert(name).first->c_str();
+	}
+
+	void traceClear()
+	{
+		std::lock_guard<std::mutex> lock(g_traceMutex);
+		for (const auto& buffer : g_traceBuffers)
+		{
+			buffer->writeCount = 0;
+		}
+	}
+
+	bool traceWriteChromeJson(const char* filename)
+	{
+		std::lock_guard<std::mutex> lock(g_traceMutex);
+
+		FILE* f = fopen(filename, "w");
+		if (!f)
+		{
+			return false;
+		}
+
+		const u64 beginTime = getTraceBeginTime();
+
+		fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		bool first = true;
+		for (const auto& buffer : g_traceBuffers)
+		{
+			fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": {\"name\": \"Thread %u\"}}",
+				first ? "" : ",\n", buffer->threadId, buffer->threadId);
+			first = false;
+
+			for (u64 i = buffer->getFirstZone(); i != buffer->writeCount; ++i)
+			{
+				const TraceZone& zone = buffer->getZone(i);
+				fprintf(f, ",\n{\"name\": ");
+				jsonWriteString(f, zone.name);
+				fprintf(f, ", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+					buffer->threadId, (zone.beginTime - beginTime) / 1000.0, (zone.endTime - zone.beginTime) / 1000.0);
+			}
+		}
+		fprintf(f, "\n]}\n");
+
+		fclose(f);
+		return true;
+	}
+
+	void tracePrintSummary()
+	{
+		std::lock_guard<std::mutex> lock(g_traceMutex);
+
+		struct ZoneStats
+		{
+			u64 count = 0;
+			u64 totalTime = 0;
+			u64 maxTime = 0;
+		};
+
+		// Zones are grouped by name contents, since the same name may come from different literals
+		std::map<std::string, ZoneStats> statsMap;
+		u64 droppedCount = 0;
+		for (const auto& buffer : g_traceBuffers)
+		{
+			droppedCount += buffer->getFirstZone();
+			for (u64 i = buffer->getFirstZone(); i != buffer->writeCount; ++i)
+			{
+				const TraceZone& zone = buffer->getZone(i);
+				const u64 time = zone.endTime - zone.beginTime;
+				ZoneStats& stats = statsMap[zone.name];
+				stats.count++;
+				stats.totalTime += time;
+				stats.maxTime = std::max(stats.maxTime, time);
+			}
+		}
+
+		std::vector<std::pair<std::string, ZoneStats>> sortedStats(statsMap.begin(), statsMap.end());
+		std::sort(sortedStats.begin(), sortedStats.end(), [](const std::pair<std::string, ZoneStats>& a, const std::pair<std::string, ZoneStats>& b)
+		{
+			return a.second.totalTime > b.second.totalTime;
+		});
+
+		printf("%-48s %10s %12s %12s %12s\n", "Zone", "Count", "Total ms", "Mean ms", "Max ms");
+		for (const auto& it : sortedStats)
+		{
+			const ZoneStats& stats = it.second;
+			printf("%-48s %10llu %12.3f %12.3f %12.3f\n", it.first.c_str(), (unsigned long long)stats.count,
+				stats.totalTime * 1e-6, stats.totalTime * 1e-6 / stats.count, stats.maxTime * 1e-6);
+		}
+
+		if (droppedCount)
+		{
+			printf("%llu oldest zones were overwritten and are not included\n", (unsigned long long)droppedCount);
+		}
+	}
+}
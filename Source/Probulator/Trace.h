@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Common.h"
+
+#include <atomic>
+#include <string>
+
+// Scoped zone instrumentation.
+// PROBULATOR_TRACE_SCOPE("name") records the time spent in the enclosing scope on the calling thread.
+// Zones are only recorded after traceSetEnabled(true), otherwise a scope costs a single relaxed load.
+// Building with PROBULATOR_TRACE=0 (CMake option PROBULATOR_TRACE) removes the instrumentation entirely.
+
+#ifndef PROBULATOR_TRACE
+#define PROBULATOR_TRACE 0
+#endif
+
+namespace Probulator
+{
+	extern std::atomic<bool> g_traceEnabled;
+
+	inline bool traceIsEnabled()
+	{
+		return g_traceEnabled.load(std::memory_order_relaxed);
+	}
+
+	void traceSetEnabled(bool state);
+
+	// Nanoseconds from a fixed point in time, using a monotonic clock
+	u64 traceGetTime();
+
+	// Records a finished zone on the calling thread.
+	// Each thread keeps the most recent zones in a fixed-size ring buffer, older zones are overwritten.
+	// The name is stored by pointer, so it must stay valid until the trace is written (see traceInternName).
+	void traceRecordZone(const char* name, u64 beginTime, u64 endTime);
+
+	// Returns a copy of the string that lives until the end of the program.
+	// Repeated calls with the same string return the same pointer.
+	const char* traceInternName(const std::string& name);
+
+	// Discards recorded zones of all threads
+	void traceClear();
+
+	// Functions below read buffers of all threads and must not run concurrently with traced code.
+
+	// Writes zones in Chrome trace event format, which can be opened in chrome://tracing or Perfetto
+	bool traceWriteChromeJson(const char* filename);
+
+	// Prints total, mean and max inclusive time for every zone name, sorted by total time
+	void tracePrintSummary();
+
+	class TraceScope
+	{
+	public:
+
+		explicit TraceScope(const char* name)
+			: m_name(traceIsEnabled() ? name : nullptr)
+			, m_beginTime(m_name ? traceGetTime() : 0)
+		{
+		}
+
+		explicit TraceScope(const std::string& name)
+			: m_name(traceIsEnabled() ? traceInternName(name) : nullptr)
+			, m_beginTime(m_name ? traceGetTime() : 0)
+		{
+		}
+
+		~TraceScope()
+		{
+			if (m_name)
+			{
+				traceRecordZone(m_name, m_beginTime, traceGetTime());
+			}
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+
+		const char* m_name;
+		u64 m_beginTime;
+	};
+}
+
+#if PROBULATOR_TRACE
+#define PROBULATOR_TRACE_CONCAT_(a, b) a##b
+#define PROBULATOR_TRACE_CONCAT(a, b) PROBULATOR_TRACE_CONCAT_(a, b)
+#define PROBULATOR_TRACE_SCOPE(name) ::Probulator::TraceScope PROBULATOR_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define PROBULATOR_TRACE_SCOPE(name) ((void)0)
+#endif
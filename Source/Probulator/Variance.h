@@ -21,7 +21,7 @@ namespace Probulator
 			M2 = M2 +  delta * (x - mean);
 		}
 
-		T getVariance()
+		T getVariance() const
 		{
 			if (n < 2)
 			{
@@ -30,5 +30,15 @@ namespace Probulator
 			T variance = M2 / (float)(n - 1);
 			return variance;
 		}
+
+		// Standard error of the mean estimate
+		T getStandardError() const
+		{
+			if (n < 2)
+			{
+				return T(0);
+			}
+			return sqrt(getVariance() / (float)n);
+		}
 	};
 }
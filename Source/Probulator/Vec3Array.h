@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Math.h"
+
+#include <vector>
+
+namespace Probulator
+{
+	// Array of 3D vectors stored as separate x, y and z component streams
+	struct Vec3Array
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+
+		size_t size() const { return x.size(); }
+
+		void resize(size_t count)
+		{
+			x.resize(count);
+			y.resize(count);
+			z.resize(count);
+		}
+
+		vec3 get(size_t index) const { return vec3(x[index], y[index], z[index]); }
+
+		void set(size_t index, const vec3& v)
+		{
+			x[index] = v.x;
+			y[index] = v.y;
+			z[index] = v.z;
+		}
+	};
+}
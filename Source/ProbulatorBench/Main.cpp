@@ -0,0 +1,701 @@
+#include <Probulator/Common.h>
+#include <Probulator/Experiments.h>
+#include <Probulator/Json.h>
+#include <Probulator/Math.h>
+#include <Probulator/Memory.h>
+#include <Probulator/Simd.h>
+#include <Probulator/SphericalGaussian.h>
+#include <Probulator/SphericalHarmonics.h>
+#include <Probulator/Thread.h>
+#include <Probulator/Vec3Array.h>
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#endif
+
+using namespace Probulator;
+
+static double getTimeSeconds()
+{
+	using namespace std::chrono;
+	return duration<double>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// Best time of several repetitions, in seconds
+template <typename F>
+static double measure(u32 repetitionCount, F fun)
+{
+	double bestTime = 1e30;
+	for (u32 repetitionIt = 0; repetitionIt < repetitionCount; ++repetitionIt)
+	{
+		double startTime = getTimeSeconds();
+		fun();
+		bestTime = std::min(bestTime, getTimeSeconds() - startTime);
+	}
+	return bestTime;
+}
+
+// Directions are processed in blocks, like rows of a lat-long image in experiments
+template <size_t L>
+static void benchmarkShEvaluate(const Vec3Array& directions, u32 repetitionCount)
+{
+	const u32 BlockSize = 256;
+
+	const u32 count = (u32)directions.size();
+	const size_t coefficientCount = shSize(L);
+
+	std::vector<float> reference(coefficientCount * count);
+	std::vector<float> result(coefficientCount * count);
+
+	double scalarTime = measure(repetitionCount, [&]()
+	{
+		for (u32 blockBegin = 0; blockBegin < count; blockBegin += BlockSize)
+		{
+			float* planes = &reference[coefficientCount * blockBegin];
+			for (u32 i = 0; i < BlockSize; ++i)
+			{
+				SphericalHarmonicsT<float, L> sh = shEvaluate<L>(directions.get(blockBegin + i));
+				for (size_t j = 0; j < coefficientCount; ++j)
+				{
+					planes[j * BlockSize + i] = sh[j];
+				}
+			}
+		}
+	});
+
+	printf("L%d %-10s %8.2f ns/direction\n", (int)L, "shEvaluate", 1e9 * scalarTime / count);
+
+	// shEvaluateBatch has no AVX-512 kernel
+	const int widestIsa = std::min((int)simdGetSupportedIsa(), (int)SimdIsa_AVX2);
+	for (int isa = SimdIsa_Scalar; isa <= widestIsa; ++isa)
+	{
+		simdSetMaxIsa((SimdIsa)isa);
+
+		double batchTime = measure(repetitionCount, [&]()
+		{
+			for (u32 blockBegin = 0; blockBegin < count; blockBegin += BlockSize)
+			{
+				shEvaluateBatch<L>(&directions.x[blockBegin], &directions.y[blockBegin], &directions.z[blockBegin],
+					BlockSize, &result[coefficientCount * blockBegin], BlockSize);
+			}
+		});
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			maxError = std::max(maxError, abs(result[i] - reference[i]));
+		}
+
+		printf("L%d %-10s %8.2f ns/direction, %5.2fx, max error %g\n",
+			(int)L, simdGetIsaName((SimdIsa)isa), 1e9 * batchTime / count, scalarTime / batchTime, maxError);
+	}
+
+	simdSetMaxIsa(SimdIsa_AVX512);
+}
+
+// Lobe weights and lobe sums of the exact scalar path compared with the fast path of every instruction set.
+// Relative error of weights is only measured above FLT_MIN, smaller results may be flushed to zero.
+// Error of sums is relative to the largest sum, as sums far from all lobes consist of tiny weights.
+static void benchmarkSgEvaluate(const Vec3Array& directions, const std::vector<SphericalGaussian>& lobes, u32 repetitionCount)
+{
+	const u32 count = (u32)directions.size();
+	const u32 lobeCount = (u32)lobes.size();
+
+	std::vector<float> reference(lobeCount * count);
+	std::vector<float> result(lobeCount * count);
+	std::vector<float> referenceSum[3];
+	std::vector<float> resultSum[3];
+	for (u32 i = 0; i < 3; ++i)
+	{
+		referenceSum[i].resize(count);
+		resultSum[i].resize(count);
+	}
+
+	auto evaluate = [&](std::vector<float>& out)
+	{
+		sgEvaluateBatch(lobes.data(), lobeCount, directions.x.data(), directions.y.data(), directions.z.data(), count, out.data(), count);
+	};
+
+	auto evaluateSum = [&](std::vector<float>* out)
+	{
+		sgEvaluateSumBatch(lobes.data(), lobeCount, directions.x.data(), directions.y.data(), directions.z.data(), count,
+			out[0].data(), out[1].data(), out[2].data());
+	};
+
+	sgSetPrecision(SgPrecision_Exact);
+	double scalarTime = measure(repetitionCount, [&]() { evaluate(reference); });
+	double scalarSumTime = measure(repetitionCount, [&]() { evaluateSum(referenceSum); });
+	sgSetPrecision(SgPrecision_Fast);
+
+	printf("%-10s %8.2f ns/direction, sum %8.2f ns/direction\n", "std::exp",
+		1e9 * scalarTime / count, 1e9 * scalarSumTime / count);
+
+	for (int isa = SimdIsa_Scalar; isa <= simdGetSupportedIsa(); ++isa)
+	{
+		simdSetMaxIsa((SimdIsa)isa);
+
+		double batchTime = measure(repetitionCount, [&]() { evaluate(result); });
+		double sumTime = measure(repetitionCount, [&]() { evaluateSum(resultSum); });
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			if (reference[i] > FLT_MIN)
+			{
+				maxError = std::max(maxError, abs(result[i] - reference[i]) / reference[i]);
+			}
+		}
+
+		float maxSumError = 0.0f;
+		for (u32 channelIt = 0; channelIt < 3; ++channelIt)
+		{
+			float maxSum = *std::max_element(referenceSum[channelIt].begin(), referenceSum[channelIt].end());
+			for (u32 i = 0; i < count; ++i)
+			{
+				maxSumError = std::max(maxSumError, abs(resultSum[channelIt][i] - referenceSum[channelIt][i]) / maxSum);
+			}
+		}
+
+		printf("%-10s %8.2f ns/direction, %5.2fx, sum %8.2f ns/direction, %5.2fx, max relative error %g, sum %g\n",
+			simdGetIsaName((SimdIsa)isa), 1e9 * batchTime / count, scalarTime / batchTime,
+			1e9 * sumTime / count, scalarSumTime / sumTime, maxError, maxSumError);
+	}
+
+	simdSetMaxIsa(SimdIsa_AVX512);
+}
+
+static void benchmarkKernels()
+{
+	const u32 directionCount = 256 * 128;
+	const u32 repetitionCount = 20;
+
+	printf("Supported instruction set: %s\n", simdGetIsaName(simdGetSupportedIsa()));
+
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> uniformDistribution;
+
+	Vec3Array directions;
+	directions.resize(directionCount);
+	for (u32 i = 0; i < directionCount; ++i)
+	{
+		vec2 sampleUv = vec2(uniformDistribution(rng), uniformDistribution(rng));
+		directions.set(i, sampleUniformSphere(sampleUv));
+	}
+
+	printf("\nSpherical harmonics evaluation, %d directions\n", directionCount);
+	benchmarkShEvaluate<1>(directions, repetitionCount);
+	benchmarkShEvaluate<2>(directions, repetitionCount);
+	benchmarkShEvaluate<3>(directions, repetitionCount);
+	benchmarkShEvaluate<4>(directions, repetitionCount);
+
+	// Default experiment settings: 12 lobes with sharpness 6, evaluated for 20000 samples
+	const u32 sgSampleCount = 20000;
+	Vec3Array sgDirections;
+	sgDirections.resize(sgSampleCount);
+	for (u32 i = 0; i < sgSampleCount; ++i)
+	{
+		sgDirections.set(i, directions.get(i));
+	}
+
+	for (float lambda : { 6.0f, 100.0f, 1000.0f })
+	{
+		std::vector<SphericalGaussian> lobes(12);
+		for (SphericalGaussian& lobe : lobes)
+		{
+			lobe.p = sampleUniformSphere(vec2(uniformDistribution(rng), uniformDistribution(rng)));
+			lobe.lambda = lambda;
+			lobe.mu = vec3(uniformDistribution(rng), uniformDistribution(rng), uniformDistribution(rng));
+		}
+
+		printf("\nSpherical Gaussian evaluation, %d lobes with sharpness %g, %d directions\n", (u32)lobes.size(), lambda, sgSampleCount);
+		benchmarkSgEvaluate(sgDirections, lobes, repetitionCount);
+	}
+}
+
+static std::vector<std::string> listProbes(const std::string& directory)
+{
+	std::vector<std::string> result;
+
+	auto isHdr = [](const std::string& name)
+	{
+		return name.size() > 4 && !strcasecmp(name.c_str() + name.size() - 4, ".hdr");
+	};
+
+#if defined(_WIN32)
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = FindFirstFileA((directory + "/*").c_str(), &findData);
+	if (findHandle != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (isHdr(findData.cFileName)) result.push_back(directory + "/" + findData.cFileName);
+		} while (FindNextFileA(findHandle, &findData));
+		FindClose(findHandle);
+	}
+#else
+	if (DIR* dir = opendir(directory.c_str()))
+	{
+		while (dirent* entry = readdir(dir))
+		{
+			if (isHdr(entry->d_name)) result.push_back(directory + "/" + entry->d_name);
+		}
+		closedir(dir);
+	}
+#endif
+
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static std::string getProbeName(const std::string& filename)
+{
+	size_t begin = filename.find_last_of("/\\");
+	begin = begin == std::string::npos ? 0 : begin + 1;
+	size_t end = filename.find_last_of('.');
+	return filename.substr(begin, end > begin ? end - begin : std::string::npos);
+}
+
+static std::vector<std::string> splitList(const char* str)
+{
+	std::vector<std::string> result;
+	std::string item;
+	for (const char* c = str; ; ++c)
+	{
+		if (*c == ',' || *c == 0)
+		{
+			if (!item.empty()) result.push_back(item);
+			item.clear();
+			if (*c == 0) break;
+		}
+		else
+		{
+			item += *c;
+		}
+	}
+	return result;
+}
+
+struct BenchmarkResult
+{
+	std::string probe;
+	std::string experiment;
+	ivec2 size = ivec2(0);
+	u32 sampleCount = 0;
+	double medianSeconds = 0.0;
+	double p95Seconds = 0.0;
+	double texelsPerSecond = 0.0;
+	u64 peakMemoryBytes = 0; // resident, since the experiment started or since the process started where it can't be reset
+	u64 allocatedBytes = 0; // heap allocations per run, including explicitly charged Eigen storage (see Memory.h)
+	u64 peakAllocatedBytes = 0; // highest live heap allocations of the experiment
+
+	std::string getKey() const
+	{
+		char key[256];
+		snprintf(key, sizeof(key), "%s/%dx%d/%u/%s", probe.c_str(), size.x, size.y, sampleCount, experiment.c_str());
+		return key;
+	}
+};
+
+// Nearest-rank percentile of sorted values
+static double getPercentile(const std::vector<double>& sortedValues, double percentile)
+{
+	size_t rank = (size_t)ceil(percentile * sortedValues.size());
+	return sortedValues[std::min(std::max(rank, (size_t)1), sortedValues.size()) - 1];
+}
+
+static double getMedian(const std::vector<double>& sortedValues)
+{
+	size_t n = sortedValues.size();
+	return n % 2 ? sortedValues[n / 2] : 0.5 * (sortedValues[n / 2 - 1] + sortedValues[n / 2]);
+}
+
+// Results are written one per line, which is what readBenchmarkResults expects
+static bool writeBenchmarkResults(const char* filename, const std::vector<BenchmarkResult>& results, u32 repetitionCount, u32 warmupCount)
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+	{
+		return false;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"threadCount\": %d,\n", taskSchedulerGetThreadCount());
+	fprintf(f, "  \"instructionSet\": \"%s\",\n", simdGetIsaName(simdGetIsa()));
+	fprintf(f, "  \"repetitionCount\": %d,\n", repetitionCount);
+	fprintf(f, "  \"warmupCount\": %d,\n", warmupCount);
+	fprintf(f, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& r = results[i];
+		fprintf(f, "    {\"probe\": ");
+		jsonWriteString(f, r.probe.c_str());
+		fprintf(f, ", \"experiment\": ");
+		jsonWriteString(f, r.experiment.c_str());
+		fprintf(f, ", \"width\": %d, \"height\": %d, \"sampleCount\": %u, "
+			"\"medianSeconds\": %.9g, \"p95Seconds\": %.9g, \"texelsPerSecond\": %.9g, \"peakMemoryBytes\": %llu, "
+			"\"allocatedBytes\": %llu, \"peakAllocatedBytes\": %llu}%s\n",
+			r.size.x, r.size.y, r.sampleCount,
+			r.medianSeconds, r.p95Seconds, r.texelsPerSecond, (unsigned long long)r.peakMemoryBytes,
+			(unsigned long long)r.allocatedBytes, (unsigned long long)r.peakAllocatedBytes,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+
+	fclose(f);
+	return true;
+}
+
+static const char* findJsonValue(const char* line, const char* key)
+{
+	std::string pattern = std::string("\"") + key + "\": ";
+	const char* value = strstr(line, pattern.c_str());
+	return value ? value + pattern.size() : nullptr;
+}
+
+static std::string readJsonString(const char* line, const char* key)
+{
+	const char* value = findJsonValue(line, key);
+	std::string result;
+	if (!value || !jsonReadString(value, result)) return std::string();
+	return result;
+}
+
+static double readJsonNumber(const char* line, const char* key)
+{
+	const char* value = findJsonValue(line, key);
+	return value ? strtod(value, nullptr) : 0.0;
+}
+
+// Reads files written by writeBenchmarkResults. This is not a general JSON parser.
+static bool readBenchmarkResults(const char* filename, std::vector<BenchmarkResult>& outResults)
+{
+	FILE* f = fopen(filename, "r");
+	if (!f)
+	{
+		return false;
+	}
+
+	char line[4096];
+	while (fgets(line, sizeof(line), f))
+	{
+		if (!findJsonValue(line, "experiment"))
+			continue;
+
+		BenchmarkResult r;
+		r.probe = readJsonString(line, "probe");
+		r.experiment = readJsonString(line, "experiment");
+		r.size = ivec2((int)readJsonNumber(line, "width"), (int)readJsonNumber(line, "height"));
+		r.sampleCount = (u32)readJsonNumber(line, "sampleCount");
+		r.medianSeconds = readJsonNumber(line, "medianSeconds");
+		r.p95Seconds = readJsonNumber(line, "p95Seconds");
+		r.texelsPerSecond = readJsonNumber(line, "texelsPerSecond");
+		r.peakMemoryBytes = (u64)readJsonNumber(line, "peakMemoryBytes");
+		r.allocatedBytes = (u64)readJsonNumber(line, "allocatedBytes");
+		r.peakAllocatedBytes = (u64)readJsonNumber(line, "peakAllocatedBytes");
+		outResults.push_back(r);
+	}
+
+	fclose(f);
+	return true;
+}
+
+// A result regresses when its median time grows by more than the relative threshold and
+// by more than the absolute threshold, which filters out noise in very short experiments.
+// Returns the number of regressions.
+static u32 compareBenchmarkResults(const std::vector<BenchmarkResult>& results, const std::vector<BenchmarkResult>& baseline,
+	double relativeThreshold, double absoluteThreshold)
+{
+	std::map<std::string, const BenchmarkResult*> baselineMap;
+	for (const BenchmarkResult& r : baseline)
+	{
+		baselineMap[r.getKey()] = &r;
+	}
+
+	printf("\nComparison with baseline (regression threshold %.1f%%, %.1f ms):\n", relativeThreshold * 100.0, absoluteThreshold * 1000.0);
+
+	u32 regressionCount = 0;
+	for (const BenchmarkResult& r : results)
+	{
+		auto it = baselineMap.find(r.getKey());
+		if (it == baselineMap.end())
+		{
+			printf("  %-40s %10.3f ms (new)\n", r.getKey().c_str(), r.medianSeconds * 1000.0);
+			continue;
+		}
+
+		const BenchmarkResult& b = *it->second;
+		double delta = r.medianSeconds - b.medianSeconds;
+		bool regression = delta > b.medianSeconds * relativeThreshold && delta > absoluteThreshold;
+		regressionCount += regression;
+
+		printf("  %-40s %10.3f ms -> %10.3f ms %+7.1f%%%s\n", r.getKey().c_str(),
+			b.medianSeconds * 1000.0, r.medianSeconds * 1000.0,
+			b.medianSeconds > 0.0 ? 100.0 * delta / b.medianSeconds : 0.0,
+			regression ? "  REGRESSION" : "");
+	}
+
+	return regressionCount;
+}
+
+static void runExperimentDependencies(Experiment& e, Experiment::SharedData& data)
+{
+	for (Experiment* dependency : e.m_dependencies)
+	{
+		if (!dependency->m_executed)
+		{
+			runExperimentDependencies(*dependency, data);
+			dependency->execute(data);
+		}
+	}
+}
+
+static void printUsage()
+{
+	printf("Usage: ProbulatorBench [options] [experiment suffixes]\n");
+	printf("Runs experiments on every probe and reports timings. All experiments that are enabled by default are used unless suffixes are given.\n");
+	printf("Options:\n");
+	printf("  --kernels                Run kernel microbenchmarks instead of experiments\n");
+	printf("  --probes <dir>           Directory with lat-long .hdr probes (default: Data/Probes)\n");
+	printf("  --sizes <list>           Output sizes, e.g. 128x64,256x128 (default: 128x64,256x128)\n");
+	printf("  --samples <list>         Radiance sample counts, e.g. 5000,20000 (default: 20000)\n");
+	printf("  --repetitions <count>    Timed runs of every experiment (default: 5)\n");
+	printf("  --warmup <count>         Untimed runs before timing (default: 1)\n");
+	printf("  --all                    Include experiments that are disabled by default\n");
+	printf("  --threads <count>        Number of worker threads, including the main thread\n");
+	printf("  --output <file>          Write results to JSON file (default: bench.json)\n");
+	printf("  --baseline <file>        Compare with results from an earlier run, exit with code 2 on regressions\n");
+	printf("  --threshold <fraction>   Relative median time increase treated as regression (default: 0.1)\n");
+	printf("  --min-delta <ms>         Absolute median time increase treated as regression (default: 2)\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::string probeDirectory = "Data/Probes";
+	std::vector<ivec2> sizes = { ivec2(128, 64), ivec2(256, 128) };
+	std::vector<u32> sampleCounts = { 20000 };
+	u32 repetitionCount = 5;
+	u32 warmupCount = 1;
+	bool includeDisabled = false;
+	u32 threadCount = 0;
+	const char* outputFilename = "bench.json";
+	const char* baselineFilename = nullptr;
+	double relativeThreshold = 0.1;
+	double absoluteThreshold = 0.002;
+	std::vector<char*> suffixes;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--kernels"))
+		{
+			benchmarkKernels();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--probes") && i + 1 < argc)
+		{
+			probeDirectory = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--sizes") && i + 1 < argc)
+		{
+			sizes.clear();
+			for (const std::string& item : splitList(argv[++i]))
+			{
+				ivec2 size;
+				if (sscanf(item.c_str(), "%dx%d", &size.x, &size.y) == 2 && size.x > 0 && size.y > 0)
+				{
+					sizes.push_back(size);
+				}
+			}
+		}
+		else if (!strcmp(argv[i], "--samples") && i + 1 < argc)
+		{
+			sampleCounts.clear();
+			for (const std::string& item : splitList(argv[++i]))
+			{
+				sampleCounts.push_back((u32)strtoul(item.c_str(), nullptr, 0));
+			}
+		}
+		else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc)
+		{
+			repetitionCount = std::max(1u, (u32)strtoul(argv[++i], nullptr, 0));
+		}
+		else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+		{
+			warmupCount = (u32)strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--all"))
+		{
+			includeDisabled = true;
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			threadCount = (u32)strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+		{
+			outputFilename = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+		{
+			baselineFilename = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+		{
+			relativeThreshold = strtod(argv[++i], nullptr);
+		}
+		else if (!strcmp(argv[i], "--min-delta") && i + 1 < argc)
+		{
+			absoluteThreshold = strtod(argv[++i], nullptr) / 1000.0;
+		}
+		else if (!strncmp(argv[i], "--", 2))
+		{
+			printf("ERROR: Unknown option '%s'\n", argv[i]);
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			suffixes.push_back(argv[i]);
+		}
+	}
+
+	std::vector<std::string> probes = listProbes(probeDirectory);
+	if (probes.empty() || sizes.empty() || sampleCounts.empty())
+	{
+		printf("ERROR: No probes found in '%s'\n", probeDirectory.c_str());
+		printUsage();
+		return 1;
+	}
+
+	std::vector<BenchmarkResult> baseline;
+	if (baselineFilename && !readBenchmarkResults(baselineFilename, baseline))
+	{
+		printf("ERROR: Failed to read baseline from file '%s'\n", baselineFilename);
+		return 1;
+	}
+
+	taskSchedulerInitialize(threadCount);
+
+	printf("Benchmarking experiments using %d threads, %d repetitions, %d warmup runs\n",
+		taskSchedulerGetThreadCount(), repetitionCount, warmupCount);
+
+	std::vector<BenchmarkResult> results;
+
+	for (const std::string& probe : probes)
+	{
+		for (ivec2 size : sizes)
+		{
+			for (u32 sampleCount : sampleCounts)
+			{
+				Experiment::SharedData data(sampleCount, size, probe.c_str());
+				if (!data.isValid())
+				{
+					printf("ERROR: Failed to read input image from file '%s'\n", probe.c_str());
+					continue;
+				}
+
+				printf("\n%s, %dx%d, %d samples\n", probe.c_str(), size.x, size.y, sampleCount);
+
+				ExperimentList experiments;
+				addAllExperiments(experiments);
+
+				for (const auto& e : experiments)
+				{
+					bool selected = e->m_enabled || includeDisabled;
+					if (!suffixes.empty())
+					{
+						selected = std::any_of(suffixes.begin(), suffixes.end(), [&](const char* suffix)
+						{
+							return !strcasecmp(e->m_suffix.c_str(), suffix);
+						});
+					}
+
+					if (!selected)
+						continue;
+
+					// Inputs are computed once and reused by every timed run
+					runExperimentDependencies(*e, data);
+
+					memoryResetCounters();
+					memoryResetPeakResidentBytes();
+
+					std::vector<double> times;
+					for (u32 runIt = 0; runIt < warmupCount + repetitionCount; ++runIt)
+					{
+						double startTime = getTimeSeconds();
+						e->execute(data);
+						double time = getTimeSeconds() - startTime;
+						if (runIt >= warmupCount)
+						{
+							times.push_back(time);
+						}
+					}
+					std::sort(times.begin(), times.end());
+
+					BenchmarkResult r;
+					r.probe = getProbeName(probe);
+					r.experiment = e->m_suffix;
+					r.size = size;
+					r.sampleCount = sampleCount;
+					r.medianSeconds = getMedian(times);
+					r.p95Seconds = getPercentile(times, 0.95);
+					r.texelsPerSecond = r.medianSeconds > 0.0 ? size.x * size.y / r.medianSeconds : 0.0;
+					r.peakMemoryBytes = memoryGetPeakResidentBytes();
+
+					const MemoryAccountStats memoryStats = memoryGetAccountStats(memoryGetAccount(e->m_name));
+					r.allocatedBytes = memoryStats.total.allocatedBytes / (warmupCount + repetitionCount);
+					r.peakAllocatedBytes = memoryStats.total.peakBytes;
+					results.push_back(r);
+
+					const double mb = 1.0 / (1024.0 * 1024.0);
+					printf("  %-10s median %10.3f ms, p95 %10.3f ms, %12.0f texels/s, peak resident %6.1f MB, allocated %6.1f MB, peak allocated %6.1f MB\n",
+						e->m_suffix.c_str(), r.medianSeconds * 1000.0, r.p95Seconds * 1000.0, r.texelsPerSecond,
+						r.peakMemoryBytes * mb, r.allocatedBytes * mb, r.peakAllocatedBytes * mb);
+				}
+			}
+		}
+	}
+
+	if (!writeBenchmarkResults(outputFilename, results, repetitionCount, warmupCount))
+	{
+		printf("ERROR: Failed to write results to file '%s'\n", outputFilename);
+	}
+	else
+	{
+		printf("\nResults written to '%s'\n", outputFilename);
+	}
+
+	u32 regressionCount = 0;
+	if (baselineFilename)
+	{
+		regressionCount = compareBenchmarkResults(results, baseline, relativeThreshold, absoluteThreshold);
+		printf("%d regressions\n", regressionCount);
+	}
+
+	taskSchedulerShutdown();
+
+	return regressionCount ? 2 : 0;
+}
@@ -1,6 +1,9 @@
 #include <Probulator/Experiments.h>
+#include <Probulator/Memory.h>
+#include <Probulator/Trace.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <fstream>
 #include <memory>
 #include <sstream>
@@ -15,6 +18,8 @@ using namespace Probulator;
 
 void generateReportHtml(const ExperimentList& experiments, const char* filename)
 {
+	PROBULATOR_TRACE_SCOPE("generateReportHtml");
+
 	Experiment* referenceMode = nullptr;
 	for(const auto& it : experiments)
 	{
@@ -257,18 +262,128 @@ static void enableExperimentsBySuffix(ExperimentList& list, u32 suffixCount, cha
 	}
 }
 
+static bool enableExperimentBySuffix(ExperimentList& list, const char* suffix)
+{
+	for (const auto& e : list)
+	{
+		if (!strcasecmp(e->m_suffix.c_str(), suffix))
+		{
+			e->m_enabled = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void printMemoryReport()
+{
+	const double mb = 1.0 / (1024.0 * 1024.0);
+
+#if PROBULATOR_MEMORY_TRACKING
+	printf("\nHeap allocations (MB):\n");
+	printf("%-48s %10s %10s %10s", "Account", "Allocated", "Peak", "Retained");
+	for (u32 phase = MemoryPhase_Projection; phase < MemoryPhase_Count; ++phase)
+	{
+		printf(" %15s", memoryGetPhaseName(MemoryPhase(phase)));
+	}
+	printf("\n");
+
+	for (const MemoryAccountStats& stats : memoryGetAllAccountStats())
+	{
+		printf("%-48s %10.2f %10.2f %10.2f", stats.name.c_str(),
+			stats.total.allocatedBytes * mb, stats.total.peakBytes * mb, stats.total.currentBytes * mb);
+		for (u32 phase = MemoryPhase_Projection; phase < MemoryPhase_Count; ++phase)
+		{
+			printf(" %15.2f", stats.phases[phase].peakBytes * mb);
+		}
+		printf("\n");
+	}
+#endif
+
+	printf("Peak resident memory: %.2f MB\n", memoryGetPeakResidentBytes() * mb);
+}
+
+static void printUsage()
+{
+	printf("Usage: Probulator [options] <LatLongEnvmap.hdr> [enabled experiments by suffix]\n");
+	printf("Options:\n");
+	printf("  --threads <count>  Number of worker threads, including the main thread (default: all hardware threads)\n");
+	printf("  --pin <mask>       Pin worker threads to CPUs in the given affinity mask, e.g. 0xFF00\n");
+	printf("  --memory           Print heap allocations by experiment and phase, and peak resident memory\n");
+	printf("  --trace <file>     Record time spent in instrumented zones, write it in Chrome trace format and print a summary\n");
+	printf("  --exact-exp        Evaluate spherical Gaussians with std::exp instead of the vectorized approximation\n");
+	printf("  --enable <suffix>  Also run an experiment that is disabled by default, e.g. SGGA (can be repeated)\n");
+}
+
 int main(int argc, char** argv)
 {
 	const ivec2 outputImageSize(256, 128);
     const u32 sampleCount = 20000;
 
-	if (argc < 2)
+	u32 threadCount = 0;
+	u64 affinityMask = 0;
+	const char* traceFilename = nullptr;
+	bool memoryReportEnabled = false;
+	std::vector<char*> positionalArgs;
+	std::vector<char*> extraSuffixes;
+
+	for (int i = 1; i < argc; ++i)
 	{
-		printf("Usage: Probulator <LatLongEnvmap.hdr> [enabled experiments by suffix]\n");
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			threadCount = (u32)strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--pin") && i + 1 < argc)
+		{
+			affinityMask = (u64)strtoull(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--memory"))
+		{
+			memoryReportEnabled = true;
+		}
+		else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+		{
+			traceFilename = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--exact-exp"))
+		{
+			sgSetPrecision(SgPrecision_Exact);
+		}
+		else if (!strcmp(argv[i], "--enable") && i + 1 < argc)
+		{
+			extraSuffixes.push_back(argv[++i]);
+		}
+		else if (!strncmp(argv[i], "--", 2))
+		{
+			printf("ERROR: Unknown option '%s'\n", argv[i]);
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			positionalArgs.push_back(argv[i]);
+		}
+	}
+
+	if (positionalArgs.empty())
+	{
+		printUsage();
 		return 1;
 	}
 
-	const char* inputFilename = argv[1];
+	if (traceFilename)
+	{
+#if PROBULATOR_TRACE
+		traceSetEnabled(true);
+#else
+		printf("WARNING: Tracing is not available, Probulator was built with PROBULATOR_TRACE disabled\n");
+		traceFilename = nullptr;
+#endif
+	}
+
+	taskSchedulerInitialize(threadCount, affinityMask);
+
+	const char* inputFilename = positionalArgs[0];
 
 	printf("Loading '%s'\n", inputFilename);
 
@@ -283,12 +398,21 @@ int main(int argc, char** argv)
     ExperimentList experiments;
     addAllExperiments(experiments);
 
-	if (argc > 2)
+	if (positionalArgs.size() > 1)
+	{
+		enableExperimentsBySuffix(experiments, (u32)positionalArgs.size() - 1, positionalArgs.data() + 1);
+	}
+
+	for (const char* suffix : extraSuffixes)
 	{
-		enableExperimentsBySuffix(experiments, argc - 2, argv + 2);
+		if (!enableExperimentBySuffix(experiments, suffix))
+		{
+			printf("ERROR: Unknown experiment '%s'\n", suffix);
+			return 1;
+		}
 	}
 
-	printf("Running experiments:\n");
+	printf("Running experiments using %d threads:\n", taskSchedulerGetThreadCount());
 
 	for (const auto& e : experiments)
 	{
@@ -296,11 +420,36 @@ int main(int argc, char** argv)
 			continue;
 
 		printf("  * %s\n", e->m_name.c_str());
-		e->runWithDepencencies(sharedData);
 	}
 
+	runAllExperiments(experiments, sharedData);
+
 	generateReportHtml(experiments, "report.html");
 	// generateReportMarkdown(experiments, inputFilename, "report.md");
 
+	taskSchedulerShutdown();
+
+	if (memoryReportEnabled)
+	{
+		printMemoryReport();
+	}
+
+	if (traceFilename)
+	{
+		traceSetEnabled(false);
+
+		printf("\n");
+		tracePrintSummary();
+
+		if (traceWriteChromeJson(traceFilename))
+		{
+			printf("Trace written to '%s'\n", traceFilename);
+		}
+		else
+		{
+			printf("ERROR: Failed to write trace to file '%s'\n", traceFilename);
+		}
+	}
+
 	return 0;
 }
\ No newline at end of file
@@ -722,6 +722,8 @@ int main(int argc, char** argv)
 {
 	printf("Probulator starting ...\n");
 
+	taskSchedulerInitialize();
+
 	glfwInit();
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -782,5 +784,7 @@ int main(int argc, char** argv)
 
 	glfwTerminate();
 
+	taskSchedulerShutdown();
+
 	return 0;
 }
\ No newline at end of file